@@ -7,12 +7,149 @@
 #include <memory>
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <csignal>
+#include <atomic>
+#include <functional>
+#include <string_view>
+#include <random>
+#include <charconv>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
 
 using namespace std;
 
 const string TRANS_FILENAME = "transactions.csv";
 const string USER_FILENAME = "users.dat";
+const string BUDGET_FILENAME = "budgets.dat";
+const string KEY_FILENAME = "ledger.key";
+
+// transactions files are sealed with AES-256-GCM in independent chunks, so
+// loads can decrypt them in parallel and appends just add chunks:
+//   header : magic "A3TX", uint32 version, uint32 chunk size, uint32 reserved
+//   chunks : uint32 plaintext length (top bit set on the last chunk of each
+//            write), 12-byte random nonce, ciphertext, 16-byte tag; each
+//            chunk holds whole lines
+// every chunk authenticates the magic, the version, its index in the file
+// (uint64) and its length field, so chunks cannot be dropped, reordered or
+// cut off after without failing the check. version 1 files authenticate only
+// magic and version; they are read, and sealed as version 2 before an append.
+// the 256-bit key is kept in ledger.key. files without the magic are in the
+// old format (each byte but '\n' XORed with 'K') and are converted on write.
+const char SEALED_FILE_MAGIC[4] = { 'A', '3', 'T', 'X' };
+const uint32_t SEALED_FILE_VERSION = 2;
+const uint32_t SEALED_FINAL_CHUNK = 0x80000000u;
+const size_t SEALED_HEADER_SIZE = 16;
+const size_t SEALED_CHUNK_SIZE = 1 << 20;
+const size_t SEALED_NONCE_SIZE = 12;
+const size_t SEALED_TAG_SIZE = 16;
+const size_t SEALED_KEY_SIZE = 32;
+
+//whole-file reads and writes go to the I/O backend in blocks of this size,
+//with up to IO_QUEUE_DEPTH blocks in flight
+const size_t IO_BLOCK_SIZE = 1 << 20;
+const unsigned IO_QUEUE_DEPTH = 32;
+
+// transactions.csv: one row per line. a full save ends with a
+// checksum line ",CRC32C <version> <block size> <length> <crc>...",
+// the CRC32C of each block of the <length> bytes before it (hex). rows
+// appended after a full save follow that line and are not covered.
+const string CHECKSUM_TAG = ",CRC32C";
+const int CHECKSUM_VERSION = 1;
+const size_t CHECKSUM_BLOCK_SIZE = 64 * 1024;
+
+// a full save stores the rows of each year in a segment file
+// "transactions.csv.<year>.<mac>" (rows, then a checksum line) and
+// rewrites transactions.csv as a manifest: one line per segment,
+// ",SEGMENT <file> <first date> <last date> <rows> <user>:<rows>/<mac>...",
+// then a checksum line. the mac after each user is an HMAC-SHA256 of that
+// user's lines in the segment, so a save for one user can tell which years it
+// changed without reading the segments. segment files are named by the HMAC
+// of their content and never modified; both are keyed by the ledger key, so
+// neither confirms guessed rows to someone without it.
+const string SEGMENT_TAG = ",SEGMENT";
+
+// transactions.csv.snap: the parsed rows of transactions.csv in load order,
+// as a position-independent image that is copied into place instead of
+// parsing the text. the save worker rebuilds it after each write, and loads
+// ignore it once any file it was built from has changed. little-endian:
+//   header : magic "A3SN", uint32 version, uint32 source count,
+//            uint32 size of header, sources and mac, 16 random id bytes
+//   sources: per file its stamp (device, inode, size, mtime sec, mtime
+//            nsec as int64), uint32 name length, name, padded to 8 bytes
+//   mac    : HMAC-SHA256 of header and sources, keyed from the ledger key
+//   body   : sealed like a transactions file (see SEALED_FILE_MAGIC); the
+//            id again, then the rows (see TransactionColumns::writeImage)
+// the stamps are in the clear so a stale snapshot is found without
+// decrypting it; the mac keeps them from being edited, and the id ties the
+// body to them.
+const string SNAPSHOT_SUFFIX = ".snap";
+const char SNAPSHOT_MAGIC[4] = { 'A', '3', 'S', 'N' };
+const uint32_t SNAPSHOT_VERSION = 3;
+const size_t SNAPSHOT_HEADER_SIZE = 32;
+const size_t SNAPSHOT_ID_SIZE = 16;
+
+// users.dat layout (version 3, little-endian):
+//   header  : magic "A3UD", uint32 version, uint32 record count,
+//             uint32 CRC32C of everything after the header (0 in version 2)
+//   offsets : uint32 file offset of each record
+//   records : uint16 username length, uint16 password length, uint8 admin,
+//             username bytes, password bytes
+const char USER_FILE_MAGIC[4] = { 'A', '3', 'U', 'D' };
+const uint32_t USER_FILE_VERSION = 3;
+const size_t USER_FILE_HEADER_SIZE = 16;
+const size_t USER_RECORD_FIXED_SIZE = 5;
+
+// budgets.dat layout (version 2, little-endian):
+//   header  : magic "A3BG", uint32 version, uint32 record count,
+//             uint32 CRC32C of everything after the header (0 in version 1)
+//   records : uint16 username length, uint8 category, float64 monthly limit,
+//             username bytes
+const char BUDGET_FILE_MAGIC[4] = { 'A', '3', 'B', 'G' };
+const uint32_t BUDGET_FILE_VERSION = 2;
+const size_t BUDGET_FILE_HEADER_SIZE = 16;
+const size_t BUDGET_RECORD_FIXED_SIZE = 11;
+
+// autosave: write at most this long after the first unsaved change,
+// or immediately once this many changes have accumulated
+const int AUTOSAVE_INTERVAL_MS = 5000;
+const int AUTOSAVE_DIRTY_ROWS = 50;
+
+// number of changes that can be undone
+const size_t UNDO_LIMIT = 100;
+
+//description completions kept per prefix and offered when adding a row
+const size_t SUGGESTION_COUNT = 5;
 
 enum TransactionType {
 	Income, Expense
@@ -30,17 +167,84 @@ enum TransactionCategory {
 	Other
 };
 
-string encrypt(const string &data) {
-	string encrypted = data;
-	char key = 'K'; // Simple XOR key
-	for (char &c : encrypted) {
-		c ^= key;
+const int TRANSACTION_TYPE_COUNT = Expense + 1;
+const int TRANSACTION_CATEGORY_COUNT = Other + 1;
+
+// display names, indexed by enum value
+constexpr std::string_view TYPE_NAMES[TRANSACTION_TYPE_COUNT] = { "Income",
+		"Expense" };
+constexpr std::string_view CATEGORY_NAMES[TRANSACTION_CATEGORY_COUNT] = {
+		"Salary", "Cash", "Gift", "Food", "Clothes", "Transportation",
+		"Entertainment", "Communication", "Other" };
+
+// lowercase names, for case-insensitive matching without allocating
+constexpr std::string_view CATEGORY_NAMES_LOWER[TRANSACTION_CATEGORY_COUNT] = {
+		"salary", "cash", "gift", "food", "clothes", "transportation",
+		"entertainment", "communication", "other" };
+
+constexpr bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++) {
+		char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + 'a' - 'A' : a[i];
+		char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] + 'a' - 'A' : b[i];
+		if (x != y) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// name -> enum, case-insensitive; return -1 for an unknown name
+constexpr int typeFromName(std::string_view name) {
+	for (int i = 0; i < TRANSACTION_TYPE_COUNT; i++) {
+		if (equalsIgnoreCase(TYPE_NAMES[i], name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+constexpr int categoryFromName(std::string_view name) {
+	for (int i = 0; i < TRANSACTION_CATEGORY_COUNT; i++) {
+		if (equalsIgnoreCase(CATEGORY_NAMES[i], name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+//whether every entry of CATEGORY_NAMES_LOWER is its CATEGORY_NAMES entry in
+//lowercase
+constexpr bool lowerNamesMatch() {
+	for (int i = 0; i < TRANSACTION_CATEGORY_COUNT; i++) {
+		if (!equalsIgnoreCase(CATEGORY_NAMES[i], CATEGORY_NAMES_LOWER[i])) {
+			return false;
+		}
+		for (char c : CATEGORY_NAMES_LOWER[i]) {
+			if (c >= 'A' && c <= 'Z') {
+				return false;
+			}
+		}
 	}
-	return encrypted;
+	return true;
 }
 
-string decrypt(const string &encrypted) {
-	return encrypt(encrypted); // XOR encryption is symmetric
+static_assert(lowerNamesMatch(), "lowercase category names out of sync");
+static_assert(typeFromName("expense") == Expense, "type table out of order");
+static_assert(categoryFromName("Other") == Other,
+		"category table out of order");
+static_assert(categoryFromName("FOOD") == Food, "category table out of order");
+
+//decode size bytes of the old XOR format in place; line breaks are stored
+//as they are
+void decodeLegacy(char *data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		if (data[i] != '\n') {
+			data[i] ^= 'K';
+		}
+	}
 }
 
 // file error exception.
@@ -57,6 +261,36 @@ public:
 	}
 };
 
+//advisory lock (flock) on "<filename>.lock", held for the object's lifetime.
+//shared locks are taken for loads, exclusive locks for saves.
+class FileLock {
+	int fd;
+
+public:
+	FileLock(const string &filename, bool exclusive);
+	~FileLock();
+
+	FileLock(const FileLock&) = delete;
+	FileLock& operator=(const FileLock&) = delete;
+};
+
+//identity of a file's contents (device, inode, size, mtime). saves replace
+//the file by rename, so any write by another process changes the stamp.
+struct FileStamp {
+	dev_t device;
+	ino_t inode;
+	off_t size;
+	long mtimeSec;
+	long mtimeNsec;
+
+	FileStamp();
+
+	//stamp of filename now; a missing file gets an empty stamp
+	static FileStamp of(const string &filename);
+
+	bool operator==(const FileStamp &other) const;
+};
+
 //represents a transaction.
 class Transaction {
 private:
@@ -72,20 +306,25 @@ public:
 	Transaction();
 
 	//Constructor.
-	Transaction(const string &username, TransactionType type,
-			const string &date, TransactionCategory category,
-			const string &description, double amount);
+	Transaction(string username, TransactionType type, string date,
+			TransactionCategory category, string description, double amount);
+
+	//parse one line of transactions.csv into this object;
+	//return false if the line is malformed or its type or category is
+	//out of range
+	bool readLine(const string &line);
 
 	//print transaction
 	void print() const;
 
 	// getters
-	string getType() const;
+	std::string_view getType() const;
 	double getAmount() const;
-	string getCategory() const;
+	std::string_view getCategory() const;
 	const string& getDate() const;
 	const string& getUsername() const;
 	string getDateForCompare() const; //get date in YYYYMMDD format
+	uint32_t getDateKey() const; //get date as the integer YYYYMMDD
 	const string& getDescription() const;
 	TransactionType getTypeInt() const;
 	TransactionCategory getCategoryInt() const;
@@ -96,26 +335,548 @@ public:
 	void setCategory(TransactionCategory category);
 	void setDate(const string &date);
 	void setDescription(const string &description);
+
+	//heap bytes held by the strings of this transaction
+	size_t heapBytes() const;
+};
+
+//format a transaction as one line of transactions.csv (no newline)
+string formatTransaction(const Transaction &trans);
+
+//check whether a line of transactions.csv belongs to username
+bool isOwnedBy(const string &line, const string &username);
+
+//parse a whole string as a number without throwing; leading whitespace and
+//a leading '+' are accepted. return false if text is not a number.
+bool parseAmount(std::string_view text, double &amount);
+
+//case-insensitive (ASCII) substring test; lowerNeedle must be lowercase.
+//uses AVX2 or SSE2 where available, scanning the stored bytes directly.
+bool containsIgnoreCase(std::string_view haystack, std::string_view lowerNeedle);
+
+//the keyword test of a search: whether a row's category name, description
+//or date contains the keyword, ignoring case
+struct KeywordMatcher {
+	string lowercase;
+	bool categories[TRANSACTION_CATEGORY_COUNT]; //decided once per category
+
+	KeywordMatcher(const string &keyword);
+
+	bool matches(int category, std::string_view description,
+			std::string_view date) const;
+};
+
+//CRC32C (Castagnoli) of data, continuing from crc; uses the SSE4.2 crc32
+//instruction where available
+uint32_t crc32c(const char *data, size_t size, uint32_t crc = 0);
+
+//the checksum line (with newline) covering text, which must end in '\n'
+string checksumLine(const string &text);
+
+//check whether a line of transactions.csv is a checksum line
+bool isChecksumLine(const string &line);
+
+//check whether a line of transactions.csv is a manifest line
+bool isSegmentLine(const string &line);
+
+//one segment of a transactions file, as listed in its manifest
+struct SegmentInfo {
+	string file; //path of the segment file
+	uint32_t fromDate; //YYYYMMDD of the earliest row
+	uint32_t toDate; //YYYYMMDD of the latest row
+	size_t rows;
+	map<string, size_t> users; //rows per user
+	map<string, string> digests; //HMAC-SHA256 (hex) of each user's lines
+
+	SegmentInfo();
+
+	//whether rows dated in [from, to] (0 = unbounded) of username
+	//(empty = anyone) can be in this segment
+	bool mayContain(uint32_t from, uint32_t to, const string &username) const;
+};
+
+//the segments listed in the manifest of a transactions file (none for a
+//file that has only rows)
+vector<SegmentInfo> readManifest(const string &filename);
+
+//read the rows of a transactions file: its segments, then the rows appended
+//since the last full save, without manifest or checksum lines. every file is
+//verified against its checksum line; FileException is thrown for damage.
+string readTransactionFile(const string &filename);
+
+//save text (rows) as a transactions file: one segment per year plus a
+//manifest. only segments whose rows changed are written.
+void writeTransactionFile(const string &filename, const string &text);
+
+//save text (the rows of owner) into a transactions file, keeping the rows of
+//other users. only the segments of years where owner's rows changed, or
+//where rows were appended since the last full save, are read and rewritten.
+void writeUserRows(const string &filename, const string &owner,
+		const string &text);
+
+//seal text (whole lines) as AES-GCM chunks numbered from firstChunk; the
+//file header comes first if firstChunk is 0
+string sealText(const string &text, uint64_t firstChunk = 0);
+
+//decrypt a transactions file image, chunks in parallel. sealed is cleared
+//for a file in the old format. a damaged, missing or reordered chunk throws
+//FileException: loading the rest would let the next save drop its rows.
+string openSealed(string &&image, const string &filename, bool &sealed);
+
+//pass the decrypted contents of a transactions file to sink, one chunk at
+//a time, without reading the whole file; damage throws as in openSealed
+void streamTransactionFile(const string &filename,
+		const std::function<void(const char*, size_t)> &sink);
+
+//append text (whole lines) to a transactions file as new sealed chunks,
+//converting a file in the old format first, then fsync
+void appendTransactionText(const string &filename, const string &text);
+
+//replace filename with data: write a temporary file, fsync it and rename it
+//over filename, so a crash leaves either the old or the new contents
+void replaceFile(const string &filename, const string &data);
+
+//one read or write submitted to an IoBackend
+struct IoRequest {
+	int fd;
+	char *data;
+	size_t size;
+	off_t offset;
+	bool write;
+	size_t transferred; //bytes read or written so far
+	int error; //errno of a failed request
+	bool done;
+
+	IoRequest(int fd, char *data, size_t size, off_t offset, bool write);
+};
+
+//asynchronous file I/O. requests complete in any order; short transfers
+//are continued until the request is done or a read reaches end of file.
+class IoBackend {
+public:
+	virtual ~IoBackend() {
+	}
+
+	virtual const char* name() const = 0;
+
+	//start req; it must stay in place until it is done
+	virtual void submit(IoRequest &req) = 0;
+
+	//wait until req is done
+	virtual void wait(IoRequest &req) = 0;
+
+	//the backend of the calling thread: io_uring where the kernel allows
+	//it, otherwise pread/pwrite
+	static IoBackend& forThread();
+};
+
+//io_uring through the raw system calls
+class UringBackend: public IoBackend {
+private:
+	int ringFd;
+	void *sqRing;
+	size_t sqRingSize;
+	void *cqRing;
+	size_t cqRingSize;
+	io_uring_sqe *sqes;
+	size_t sqesSize;
+	unsigned *sqTail;
+	unsigned sqMask;
+	unsigned *sqArray;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned cqMask;
+	io_uring_cqe *cqes;
+	unsigned entries;
+	unsigned inFlight;
+
+	void push(IoRequest &req);
+	void reap(); //handle every completion that is ready
+	void unmap();
+public:
+	//throws FileException if the kernel has no io_uring for us
+	UringBackend();
+	~UringBackend();
+
+	UringBackend(const UringBackend&) = delete;
+	UringBackend& operator=(const UringBackend&) = delete;
+
+	const char* name() const;
+	void submit(IoRequest &req);
+	void wait(IoRequest &req);
+};
+
+//blocking pread/pwrite: requests are done by the time submit returns
+class PreadBackend: public IoBackend {
+public:
+	const char* name() const;
+	void submit(IoRequest &req);
+	void wait(IoRequest &req);
+};
+
+//a whole-file read in flight, IO_BLOCK_SIZE blocks at a time
+class FileRead {
+private:
+	IoBackend &io;
+	string filename;
+	int fd;
+	string image;
+	vector<IoRequest> blocks;
+	size_t submitted;
+public:
+	FileRead(const string &filename, IoBackend &io = IoBackend::forThread());
+	~FileRead();
+
+	FileRead(const FileRead&) = delete;
+	FileRead& operator=(const FileRead&) = delete;
+
+	//false if the file could not be opened
+	bool opened() const;
+
+	//wait for the rest of the file and return its contents
+	string finish();
+};
+
+//read the whole of filename into image; return false if it cannot be opened
+bool readFileImage(const string &filename, string &image);
+
+//a replaceFile in flight: data is being written to filename.tmp, and
+//commit() waits for it, fsyncs and renames it over filename. data must
+//outlive the FileReplace; without a commit the temporary file is removed.
+class FileReplace {
+private:
+	IoBackend &io;
+	string filename;
+	string tmpName;
+	int fd;
+	vector<IoRequest> blocks;
+	size_t submitted;
+
+	void waitAll();
+public:
+	FileReplace(const string &filename, std::string_view data,
+			IoBackend &io = IoBackend::forThread(), mode_t mode = 0644);
+	~FileReplace();
+
+	FileReplace(const FileReplace&) = delete;
+	FileReplace& operator=(const FileReplace&) = delete;
+
+	//syncDirectory can be left off when a later replace in the same
+	//directory syncs it
+	void commit(bool syncDirectory = true);
+};
+
+//node allocation counters of one allocation policy
+struct AllocationCounters {
+	std::atomic<uint64_t> allocations; //nodes allocated
+	std::atomic<uint64_t> releases; //nodes released
+	std::atomic<uint64_t> systemAllocations; //blocks taken from the heap
+	std::atomic<uint64_t> systemBytes; //bytes taken from the heap, in total
+	std::atomic<int64_t> liveBytes; //bytes of nodes not yet released
+	std::atomic<int64_t> heldBytes; //bytes taken from the heap and kept
+
+	AllocationCounters();
+	void print(const string &name) const;
+
+	//average size of a live node, shared_ptr control block included
+	size_t nodeBytes() const;
+};
+
+//objects and bytes held by one part of the program
+struct MemoryUsage {
+	string name;
+	size_t objects;
+	size_t bytes;
+	bool perRow; //part of what each transaction costs
+
+	MemoryUsage(const string &name, size_t objects = 0, size_t bytes = 0,
+			bool perRow = false);
+};
+
+//heap bytes a string holds beyond the string object itself
+size_t heapBytes(const string &text);
+
+//heap bytes of one std::map node of Map: the key and value, after the
+//tree links (colour, parent, left and right), each padded to a pointer
+template<class Map>
+size_t mapNodeBytes() {
+	return sizeof(typename Map::value_type) + 4 * sizeof(void*);
+}
+
+//print usage as a table, with the bytes the perRow parts hold per
+//transaction
+void printMemoryUsage(const vector<MemoryUsage> &usage, size_t transactions);
+
+//allocation policies for LinkedList nodes. a policy object lives in each
+//list and hands out std allocators for the node type:
+//  HeapPolicy  - one heap allocation per node
+//  PoolPolicy  - fixed-size blocks from shared slabs, recycled through a
+//                free list; slabs are kept, so steady-state edits do not
+//                reach malloc. for long-lived lists such as the ledger
+//  ArenaPolicy - bump allocation from the list's own arena; blocks are
+//                only given back all at once when the list is cleared and
+//                its last node is gone. for short-lived result queues
+class HeapPolicy {
+public:
+	template<class T>
+	struct Allocator {
+		typedef T value_type;
+
+		Allocator() {
+		}
+
+		template<class U>
+		Allocator(const Allocator<U>&) {
+		}
+
+		T* allocate(size_t n) {
+			counters().allocations++;
+			counters().systemAllocations++;
+			counters().systemBytes += n * sizeof(T);
+			counters().liveBytes += n * sizeof(T);
+			counters().heldBytes += n * sizeof(T);
+			return std::allocator<T>().allocate(n);
+		}
+
+		void deallocate(T *p, size_t n) {
+			counters().releases++;
+			counters().liveBytes -= n * sizeof(T);
+			counters().heldBytes -= n * sizeof(T);
+			std::allocator<T>().deallocate(p, n);
+		}
+
+		bool operator==(const Allocator&) const {
+			return true;
+		}
+
+		bool operator!=(const Allocator&) const {
+			return false;
+		}
+	};
+
+	template<class T>
+	Allocator<T> allocator() {
+		return Allocator<T>();
+	}
+
+	void release() {
+	}
+
+	void swap(HeapPolicy&) {
+	}
+
+	static AllocationCounters& counters();
+};
+
+//free lists of fixed-size blocks, shared by all PoolPolicy lists
+class NodePool {
+private:
+	struct FreeBlock {
+		FreeBlock *next;
+	};
+
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+	std::mutex lock;
+	FreeBlock *freeList;
+	char *slab; //unused part of the current slab
+	size_t slabLeft;
+	size_t blockSize;
+	vector<char*> slabs;
+
+	explicit NodePool(size_t blockSize);
+public:
+	NodePool(const NodePool&) = delete;
+	NodePool& operator=(const NodePool&) = delete;
+
+	//the pool for blocks of size bytes; pools live until the program ends,
+	//so nodes of static lists can still be released
+	static NodePool& forSize(size_t size);
+
+	void* allocate();
+	void deallocate(void *block);
+};
+
+class PoolPolicy {
+public:
+	template<class T>
+	struct Allocator {
+		typedef T value_type;
+
+		Allocator() {
+		}
+
+		template<class U>
+		Allocator(const Allocator<U>&) {
+		}
+
+		T* allocate(size_t n) {
+			counters().allocations++;
+			counters().liveBytes += n * sizeof(T);
+			if (n != 1) {
+				counters().systemAllocations++;
+				counters().systemBytes += n * sizeof(T);
+				counters().heldBytes += n * sizeof(T);
+				return std::allocator<T>().allocate(n);
+			}
+			static NodePool &pool = NodePool::forSize(sizeof(T));
+			return (T*) pool.allocate();
+		}
+
+		void deallocate(T *p, size_t n) {
+			counters().releases++;
+			counters().liveBytes -= n * sizeof(T);
+			if (n != 1) {
+				counters().heldBytes -= n * sizeof(T);
+				std::allocator<T>().deallocate(p, n);
+				return;
+			}
+			static NodePool &pool = NodePool::forSize(sizeof(T));
+			pool.deallocate(p);
+		}
+
+		bool operator==(const Allocator&) const {
+			return true;
+		}
+
+		bool operator!=(const Allocator&) const {
+			return false;
+		}
+	};
+
+	template<class T>
+	Allocator<T> allocator() {
+		return Allocator<T>();
+	}
+
+	void release() {
+	}
+
+	void swap(PoolPolicy&) {
+	}
+
+	static AllocationCounters& counters();
+};
+
+//bump allocator behind ArenaPolicy; freed as a whole when the last list
+//holding it lets go
+class NodeArena {
+private:
+	static constexpr size_t FIRST_BLOCK_SIZE = 4 * 1024;
+	static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024; //under the mmap threshold
+	vector<char*> blocks;
+	char *next;
+	size_t left;
+	size_t blockSize;
+	size_t totalSize; //of all blocks
+public:
+	NodeArena();
+	~NodeArena();
+
+	NodeArena(const NodeArena&) = delete;
+	NodeArena& operator=(const NodeArena&) = delete;
+
+	void* allocate(size_t size, size_t align);
+};
+
+class ArenaPolicy {
+private:
+	std::shared_ptr<NodeArena> arena; //created on first allocation
+public:
+	//holds the arena by plain pointer, so allocations cost no reference
+	//counting; the list's nodes never outlive the list's policy
+	template<class T>
+	struct Allocator {
+		typedef T value_type;
+		NodeArena *arena;
+
+		explicit Allocator(NodeArena *arena) :
+				arena(arena) {
+		}
+
+		template<class U>
+		Allocator(const Allocator<U> &other) :
+				arena(other.arena) {
+		}
+
+		T* allocate(size_t n) {
+			counters().allocations++;
+			counters().liveBytes += n * sizeof(T);
+			return (T*) arena->allocate(n * sizeof(T), alignof(T));
+		}
+
+		void deallocate(T*, size_t n) {
+			//the memory goes back with the arena
+			counters().releases++;
+			counters().liveBytes -= n * sizeof(T);
+		}
+
+		template<class U>
+		bool operator==(const Allocator<U> &other) const {
+			return arena == other.arena;
+		}
+
+		template<class U>
+		bool operator!=(const Allocator<U> &other) const {
+			return arena != other.arena;
+		}
+	};
+
+	template<class T>
+	Allocator<T> allocator() {
+		if (!arena) {
+			arena = std::make_shared<NodeArena>();
+		}
+		return Allocator<T>(arena.get());
+	}
+
+	//start a new arena; call only once the nodes are gone
+	void release() {
+		arena.reset();
+	}
+
+	void swap(ArenaPolicy &other) {
+		arena.swap(other.arena);
+	}
+
+	static AllocationCounters& counters();
 };
 
-template<class DataType>
+template<class DataType, class AllocPolicy = HeapPolicy>
 class LinkedList {
 protected:
 	struct Node {
 		DataType data;
 		std::shared_ptr<Node> next;
 		std::weak_ptr<Node> prev;
+
+		//construct data in place from args
+		template<class ... Args>
+		Node(Args &&... args) :
+				data(std::forward<Args>(args)...) {
+		}
 	};
 protected:
 	std::shared_ptr<Node> head;
 	std::shared_ptr<Node> tail;
 	int count;
+	AllocPolicy nodes;
 protected:
-	std::shared_ptr<Node> createNode(const DataType &data) {
-		std::shared_ptr<Node> node = std::make_shared<Node>();
-		node->data = data;
-		node->next = nullptr;
-		node->prev.reset();
+	template<class ... Args>
+	std::shared_ptr<Node> createNode(Args &&... args) {
+		return std::allocate_shared<Node>(nodes.template allocator<Node>(),
+				std::forward<Args>(args)...);
+	}
+
+	std::shared_ptr<Node> nodeAt(int index) const {
+		if (!(index >= 0 && index < size())) {
+			throw "LinkedList::get: Invalid index";
+		}
+
+		std::shared_ptr<Node> node = head;
+		while (index > 0) {
+			node = node->next;
+			index--;
+		}
 		return node;
 	}
 public:
@@ -139,6 +900,7 @@ public:
 
 		head = nullptr;
 		tail = nullptr;
+		nodes.release();
 	}
 	~LinkedList() {
 		clear();
@@ -147,62 +909,97 @@ public:
 	void saveFile(ostream &ofs) const {
 		std::shared_ptr<Node> node = head;
 		while (node) {
-
-			ostringstream oss;
-			oss << node->data.getUsername() << ",";
-			oss << node->data.getTypeInt() << ",";
-			oss << node->data.getDate() << ",";
-			oss << node->data.getCategoryInt() << ",";
-			oss << node->data.getDescription() << ",";
-			oss << node->data.getAmount();
-
-			string line = oss.str();
-			line = encrypt(line);
-			ofs << line << endl;
-
+			ofs << formatTransaction(node->data) << '\n';
 			node = node->next;
 		}
 	}
 
-	const Transaction& get(int index) const {
-		if (!(index >= 0 && index < size())) {
-			throw "LinkedList::get: Invalid index";
+	//nodes and the heap bytes behind them and their elements
+	MemoryUsage memoryUsage(const string &name) const {
+		MemoryUsage usage(name, count, count * AllocPolicy::counters().nodeBytes());
+		std::shared_ptr<Node> node = head;
+		while (node) {
+			usage.bytes += node->data.heapBytes();
+			node = node->next;
 		}
+		return usage;
+	}
 
+	//call f on each element, in order
+	template<class F>
+	void forEach(F f) const {
 		std::shared_ptr<Node> node = head;
-		while (index > 0) {
+		while (node) {
+			f(node->data);
 			node = node->next;
-			index--;
 		}
-
-		return node->data;
 	}
 
-	void set(int index, const DataType &data) {
-		if (!(index >= 0 && index < size())) {
-			throw "LinkedList::get: Invalid index";
+	//copy all elements, in order, to the end of out
+	void appendTo(vector<DataType> &out) const {
+		std::shared_ptr<Node> node = head;
+		while (node) {
+			out.push_back(node->data);
+			node = node->next;
 		}
+	}
 
+	//move all elements, in order, to the end of out and empty the list
+	void moveTo(vector<DataType> &out) {
+		out.reserve(out.size() + size());
 		std::shared_ptr<Node> node = head;
-		while (index > 0) {
+		while (node) {
+			out.push_back(std::move(node->data));
 			node = node->next;
-			index--;
 		}
+		clear();
+	}
 
-		node->data = data;
+	const DataType& get(int index) const {
+		return nodeAt(index)->data;
 	}
 
-	void remove(int index) {
-		if (!(index >= 0 && index < size())) {
-			throw "LinkedList::get: Invalid index";
+	//exchange all elements with other in O(1)
+	void swap(LinkedList &other) {
+		std::swap(head, other.head);
+		std::swap(tail, other.tail);
+		std::swap(count, other.count);
+		nodes.swap(other.nodes);
+	}
+
+	void set(int index, const DataType &data) {
+		nodeAt(index)->data = data;
+	}
+
+	void set(int index, DataType &&data) {
+		nodeAt(index)->data = std::move(data);
+	}
+
+	//insert data before position index (index == size() appends)
+	void insert(int index, DataType &&data) {
+		if (index == count) {
+			emplaceTail(std::move(data));
+			return;
 		}
 
-		std::shared_ptr<Node> node = head;
-		while (index > 0) {
-			node = node->next;
-			index--;
+		std::shared_ptr<Node> next = nodeAt(index);
+		if (next == head) {
+			emplaceHead(std::move(data));
+			return;
 		}
 
+		std::shared_ptr<Node> node = createNode(std::move(data));
+		std::shared_ptr<Node> prev = next->prev.lock();
+		node->prev = prev;
+		node->next = next;
+		prev->next = node;
+		next->prev = node;
+		count++;
+	}
+
+	void remove(int index) {
+		std::shared_ptr<Node> node = nodeAt(index);
+
 		if (node == head) {
 			removeHead();
 		} else if (node == tail) {
@@ -240,30 +1037,52 @@ public:
 		}
 	}
 
-	void addToHead(const DataType &data) {
+	//construct an element in place at the head and return it
+	template<class ... Args>
+	DataType& emplaceHead(Args &&... args) {
+		std::shared_ptr<Node> node = createNode(std::forward<Args>(args)...);
 		if (count == 0) {
-			head = tail = createNode(data);
+			head = tail = node;
 		} else {
-			std::shared_ptr<Node> node = createNode(data);
 			node->next = head;
 			head->prev = node;
 			head = node;
 		}
 
 		count++;
+		return node->data;
 	}
 
-	void addToTail(const DataType &data) {
+	//construct an element in place at the tail and return it
+	template<class ... Args>
+	DataType& emplaceTail(Args &&... args) {
+		std::shared_ptr<Node> node = createNode(std::forward<Args>(args)...);
 		if (count == 0) {
-			head = tail = createNode(data);
+			head = tail = node;
 		} else {
-			std::shared_ptr<Node> node = createNode(data);
 			node->prev = tail;
 			tail->next = node;
 			tail = node;
 		}
 
 		count++;
+		return node->data;
+	}
+
+	void addToHead(const DataType &data) {
+		emplaceHead(data);
+	}
+
+	void addToHead(DataType &&data) {
+		emplaceHead(std::move(data));
+	}
+
+	void addToTail(const DataType &data) {
+		emplaceTail(data);
+	}
+
+	void addToTail(DataType &&data) {
+		emplaceTail(std::move(data));
 	}
 
 	int size() const {
@@ -275,7 +1094,7 @@ public:
 	}
 };
 
-class Queue: public LinkedList<Transaction> {
+class Queue: public LinkedList<Transaction, ArenaPolicy> {
 
 public:
 	Queue() {
@@ -286,11 +1105,16 @@ public:
 		addToTail(trans);
 	}
 
-	Transaction front() const {
+	void push(Transaction &&trans) {
+		addToTail(std::move(trans));
+	}
+
+	const Transaction& front() const {
+		static const Transaction none;
 		if (size() > 0) {
 			return head->data;
 		} else {
-			return Transaction();
+			return none;
 		}
 	}
 
@@ -310,22 +1134,366 @@ public:
 	}
 };
 
-//manage transactions
-class TransactionList: public LinkedList<Transaction> {
+//writes transactions to disk on a background thread. a rewrite does not
+//copy the rows: the worker formats them when it writes, so back-to-back
+//changes to the same file are coalesced into one pass over the rows.
+class SaveWorker {
 private:
+	struct Job {
+		string filename;
+		bool append; //append rows instead of rewriting the file
+		string owner; //if set, the rewrite replaces only this user's rows
+		vector<Transaction> rows; //rows to append
+		std::function<void(string&)> format; //rewrite: appends the rows to out
+	};
+
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable wake; //signals the worker
+	std::condition_variable idle; //signals flush() callers
+	deque<Job> jobs;
+	int changes; //changes submitted since the last write
+	std::chrono::steady_clock::time_point deadline; //latest time to write
+	int intervalMs;
+	int dirtyThreshold;
+	bool writing;
+	bool flushing;
+	bool stopping;
+	string lastError;
+	map<string, FileStamp> stamps; //files as this process last read or wrote them
+
+	void run();
+
+	//serialize the job's rows and write them to filename, then fsync
+	void writeRows(const Job &job);
+
+	//queue job; a rewrite replaces anything still queued
+	void enqueue(Job &&job);
+public:
+	SaveWorker();
+	~SaveWorker();
+
+	//start the worker thread
+	void start(int intervalMs, int dirtyThreshold);
+
+	//queue rows to be appended to filename
+	void submitAppend(const string &filename, vector<Transaction> &&rows);
+
+	//queue a rewrite of filename. format runs on the worker thread when the
+	//write starts and appends the rows to save (whole lines) to its argument;
+	//it must lock whatever it reads. a rewrite with an owner keeps the other
+	//users' rows found in the file.
+	void submitRewrite(const string &filename, const string &owner,
+			std::function<void(string&)> format);
+
+	//write everything queued now and wait until it is on disk
+	void flush();
+
+	//flush and stop the worker thread
+	void stop();
+
+	bool running() const;
+
+	//return and clear the error from the last failed write, if any
+	string takeError();
+
+	//record that this process has just read filename as it is now
+	void setStamp(const string &filename, const FileStamp &stamp);
+
+	//check that no other process wrote filename since this process last
+	//read it or wrote it in full
+	bool isCurrent(const string &filename);
+};
+
+//column-oriented (structure of arrays) copy of a list of transactions.
+//hot fields used by filters, sums and sorts sit in dense arrays; the
+//variable-length strings live in one shared buffer.
+class TransactionColumns {
+private:
+	struct StringRef {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	vector<uint8_t> types;
+	vector<uint8_t> categories;
+	vector<uint32_t> dates; //YYYYMMDD
+	vector<double> amounts;
+	string strings; //username and description bytes
+	vector<StringRef> usernames;
+	vector<StringRef> descriptions;
+
+	StringRef addString(const string &value);
+public:
+	void clear();
+	void reserve(size_t rows);
+	void append(const Transaction &trans);
+	size_t size() const;
+
+	TransactionType type(size_t row) const;
+	TransactionCategory category(size_t row) const;
+	uint32_t date(size_t row) const;
+	double amount(size_t row) const;
+	std::string_view username(size_t row) const;
+	std::string_view description(size_t row) const;
+
+	//write the date of row as "DD/MM/YYYY" into out (10 chars, no NUL)
+	void formatDate(size_t row, char *out) const;
+
+	//materialize row as a Transaction
+	Transaction row(size_t row) const;
+
+	//parse a line of transactions.csv straight into the columns, as
+	//Transaction::readLine would; return false if it is not a row. exact
+	//is cleared if row() would not give back the same row (a date not in
+	//DD/MM/YYYY form, or an unknown type or category). the bytes after
+	//line must not continue its amount, as in a text of whole lines.
+	bool appendLine(std::string_view line, bool &exact);
+
+	//append the columns to out: uint32 rows, uint32 string bytes, then
+	//types, categories, dates, amounts, username and description refs
+	//(uint32 offset and length) and the string bytes, each padded to 8
+	void writeImage(string &out) const;
+
+	//replace the columns with an image from writeImage; return false if
+	//it is malformed
+	bool readImage(const char *data, size_t size);
+
+	//bytes reserved by the columns
+	size_t memoryBytes() const;
+};
+
+//save text (the rows of filename as readTransactionFile returned them) as
+//the snapshot of the transactions file filename. a snapshot is only a
+//cache, so failures are ignored.
+void writeSnapshot(const string &filename, const string &text);
+
+//rebuild the snapshot of the transactions file filename from the file as it
+//is now. failures are ignored, like writeSnapshot's.
+void refreshSnapshot(const string &filename);
+
+//load the snapshot of filename into cols; return false if there is none or
+//it is stale or damaged
+bool readSnapshot(const string &filename, TransactionColumns &cols);
+
+//columns rows can be sorted on
+enum SortField {
+	SortByDate,
+	SortByCategory,
+	SortByType,
+	SortByAmount
+};
+
+struct SortColumn {
+	SortField field;
+	bool descending;
+};
+
+//past descriptions of one user in a radix trie keyed by the lowercased
+//text. every node keeps the SUGGESTION_COUNT most used descriptions below
+//it, so completing a prefix walks only the prefix. descriptions are only
+//ever added or used again, which lets a use update those lists along one
+//path in O(depth * SUGGESTION_COUNT).
+class DescriptionIndex {
+private:
+	struct Entry {
+		string text; //as first entered
+		uint32_t uses;
+		uint64_t lastUse; //ties go to the latest used
+	};
+
+	struct Node {
+		string label; //lowercased edge from the parent
+		vector<uint32_t> children;
+		int32_t entry; //description ending here, -1 if none
+		uint32_t top[SUGGESTION_COUNT]; //best entries below, best first
+		uint8_t topCount;
+
+		explicit Node(string label);
+	};
+
+	vector<Node> nodes; //nodes[0] is the root
+	vector<Entry> entries;
+	uint64_t useCount;
+
+	//whether entry a should be offered before entry b
+	bool before(uint32_t a, uint32_t b) const;
+
+	//put entry in the top list of node, if it ranks there
+	void raise(uint32_t node, uint32_t entry);
+
+	//the child of node whose label starts with c, or 0
+	uint32_t childStarting(uint32_t node, char c) const;
+public:
+	DescriptionIndex();
+
+	void clear();
+
+	//count one more use of description
+	void add(const string &description);
+
+	//up to count past descriptions starting with prefix (any case), most
+	//used first
+	vector<string> complete(const string &prefix, size_t count) const;
+
+	size_t size() const;
+	size_t memoryBytes() const;
+};
+
+//row numbers of cols in the order given by columns (first is most
+//significant). each row's sort columns are packed into 64-bit integer
+//keys, which are LSD radix sorted 8 bits a pass: O(n) and stable. columns
+//wider than one key are sorted a key at a time, least significant first.
+vector<uint32_t> radixOrder(const TransactionColumns &cols,
+		const vector<SortColumn> &columns);
+
+//keeps running per-month, per-category expense totals for one user and
+//raises an alert when a change pushes a month over its budget.
+//each change costs O(1); totals are only kept while a budget is set.
+class BudgetTracker {
+private:
+	double limits[TRANSACTION_CATEGORY_COUNT]; //0 means no budget
+	unordered_map<uint32_t, double> spent; //key: YYYYMM * 16 + category
+	vector<string> alerts;
+
+	static uint32_t keyOf(const Transaction &trans);
+public:
+	BudgetTracker();
+
+	//replace all limits; totals must be rebuilt afterwards
+	void setLimits(const double newLimits[TRANSACTION_CATEGORY_COUNT]);
+	void setLimit(TransactionCategory category, double limit);
+	double getLimit(TransactionCategory category) const;
+
+	//true if any budget is set
+	bool active() const;
+
+	//true if trans counts towards a budget
+	bool watches(const Transaction &trans) const;
+
+	//forget all totals
+	void reset();
+
+	//count trans in (sign 1) or out of (sign -1) its month's total
+	void apply(const Transaction &trans, int sign);
+
+	//return and clear the alerts raised so far
+	vector<string> takeAlerts();
+};
+
+//orderings for top-k queries
+enum RankOrder {
+	LatestFirst, //by date, most recent first
+	LargestExpenseFirst //expenses only, by amount, largest first
+};
+
+//fields a ledger report can group by, combined as a bit mask
+enum GroupField {
+	GroupByUser = 1,
+	GroupByCategory = 2,
+	GroupByMonth = 4
+};
+
+//aggregate of the rows in one group; fields not grouped by are empty/0
+struct GroupTotal {
+	string username;
+	uint32_t month; //YYYYMM
+	int category; //-1 if not grouped by category
+	size_t count;
+	double income;
+	double expense;
+
+	GroupTotal();
+
+	//mean amount of the rows in the group
+	double average() const;
+};
+
+//operations kept in the undo/redo log; each one describes how to revert a
+//change and turns into its own inverse when applied
+enum EditKind {
+	EditInsert, //insert row at index
+	EditErase, //remove the row at index
+	EditReplace, //swap row with the row at index
+	EditTruncate, //remove the last count rows
+	EditAppend, //append rows
+	EditPermute //put the row at order[i] in position i
+};
+
+//the rows of a ledger, in pooled nodes
+typedef LinkedList<Transaction, PoolPolicy> RowList;
+
+class TransactionList: public RowList {
+private:
+	struct Edit {
+		EditKind kind;
+		int index;
+		size_t count;
+		Transaction row;
+		vector<Transaction> rows;
+		vector<uint32_t> order;
+
+		Edit(EditKind kind, int index = 0, size_t count = 0);
+	};
+
 	string currentUser;
-	LinkedList<Transaction> others;
+	map<string, RowList> others; //other users' rows, by user
+	string sourceFile; //file to load from on first access
+	bool loaded; //false until the source file has been parsed
+	RowList pending; //rows added before loading
+	SaveWorker *saver; //background autosave, may be null
+	mutable std::mutex rowsLock; //held while the rows change, and by the
+			//autosave worker while it formats them
+	mutable TransactionColumns cols; //columnar copy of the rows
+	mutable bool colsValid; //false once the rows change
+	mutable std::mutex colsLock; //readers may build cols concurrently
+	BudgetTracker budgets; //monthly budget totals of currentUser's rows
+	DescriptionIndex descriptions; //currentUser's descriptions so far
+	bool descriptionsValid; //false until rebuilt after a user switch
+	deque<Edit> undoLog; //inverse of each change, latest last
+	deque<Edit> redoLog; //inverse of each undo, latest last
+
+	//tell the autosave worker the rows changed
+	void changed();
+
+	//append owner's rows (every row if owner is empty) to out, wherever
+	//they are parked; called by the autosave worker
+	void formatRows(const string &owner, string &out) const;
+
+	//log the inverse of a new change; a new change discards the redo log
+	void record(Edit &&edit);
+
+	//apply edit to the rows and turn it into its inverse (takes rowsLock)
+	void apply(Edit &edit);
+
+	//recount all rows into the budget totals
+	void rebuildBudgets();
 public:
 	//Constructor.
 	TransactionList();
 
+	//waits for the autosave worker, which may still read the rows
+	~TransactionList();
+
+	//switch to username's rows; loaded rows are kept, so switching users
+	//exchanges partitions instead of reloading the file
 	void setCurrentUser(const string &username);
 
 	//load data from file
 	void loadFile(const string &filename);
 
-	//save data to file
-	void saveFile(const string &filename) const;
+	//use filename as the data source, deferring the load until rows are needed.
+	//rows already loaded from filename are kept if no other process wrote it.
+	void attachFile(const string &filename);
+
+	//load the attached file if it has not been loaded yet
+	void materialize();
+
+	//autosave every change through worker (null disables autosave)
+	void setSaveWorker(SaveWorker *worker);
+
+	//save data to file (only appends new rows if nothing was loaded)
+	void saveFile(const string &filename);
 
 	// prompt user to select an transaction
 	// return a number in range [0, size)
@@ -333,21 +1501,136 @@ public:
 
 	//add Transaction
 	void addTransaction(const Transaction &trans);
+	void addTransaction(Transaction &&trans);
+
+	//append rows read from a file, as a load does: nothing is logged for
+	//undo or autosaved, and the budgets are recounted once
+	void appendLoaded(vector<Transaction> &&rows);
+
+	//append rows as one batch, leaving out rows already present (same date,
+	//amount and description); each row in the list matches at most one
+	//imported row. return the number of rows appended
+	size_t importTransactions(vector<Transaction> &&rows);
 
 	//modify transaction by the index of transaction in array.
 	void modifyTransaction(int index, const Transaction &trans);
+	void modifyTransaction(int index, Transaction &&trans);
 
 	//delete transaction by the index of transaction in array.
 	void deleteTransaction(int index);
 
-	//search transaction (linear search) by category or date.
+	//revert the latest change; return false if there is nothing to undo
+	bool undo();
+
+	//reapply the latest undone change; return false if there is none
+	bool redo();
+
+	//search transaction (linear search) by category, date or description.
 	void searchTransaction(const string &keyword, Queue &queue);
 
+	//search the rows already in memory, without loading the attached file
+	void findTransactions(const string &keyword, Queue &queue) const;
+
 	//display all transactions
-	void displayTransactions() const;
+	void displayTransactions();
 
-	//sort transactions by date
+	//sort transactions by date, latest first
 	void sortTransactions();
+
+	//sort transactions by several columns, the first most significant
+	void sortTransactions(const vector<SortColumn> &columns);
+
+	//set currentUser's monthly budgets (0 = none), e.g. from BudgetBook
+	void setBudgetLimits(const double limits[TRANSACTION_CATEGORY_COUNT]);
+
+	//set one monthly budget (0 removes it) and check it against the rows
+	void setBudget(TransactionCategory category, double limit);
+
+	//return and clear the budget alerts raised by changes
+	vector<string> takeAlerts();
+
+	//put the first k transactions in the given order into queue,
+	//without sorting or reordering the list
+	void topTransactions(RankOrder order, int k, Queue &queue);
+
+	//top-k query over the rows already in memory (bounded heap, O(n log k))
+	void findTop(RankOrder order, int k, Queue &queue) const;
+
+	//the rows at positions (each < size()), in that order, found in one
+	//walk of the list
+	vector<const Transaction*> rowsAt(const vector<uint32_t> &positions) const;
+
+	//return the rows as columns, building them if the rows changed
+	const TransactionColumns& columns() const;
+
+	//sum of the amounts of all rows of the given type
+	double totalAmount(TransactionType type) const;
+
+	//aggregate every user's rows by the GroupField bits in fields, using
+	//per-thread hash tables merged at the end; out is sorted by group
+	void groupTotals(int fields, vector<GroupTotal> &out);
+
+	//append what the rows, other users' rows, pending rows, undo history
+	//and column index hold, and return the number of rows in memory;
+	//nothing is loaded for it
+	size_t memoryUsage(vector<MemoryUsage> &out) const;
+
+	//up to count of currentUser's past descriptions starting with prefix,
+	//most used first
+	vector<string> completeDescription(const string &prefix, size_t count);
+};
+
+//in-process ledger shared by many sessions, partitioned by username.
+//each partition has its own reader/writer lock, so readers never block each
+//other and writers to different users' partitions run in parallel.
+class Ledger {
+private:
+	struct Partition {
+		mutable std::shared_mutex lock;
+		TransactionList rows;
+	};
+
+	mutable std::shared_mutex partitionsLock; //guards the map, not the rows
+	map<string, unique_ptr<Partition>> partitions;
+
+	//return the partition for username, or null if it has no rows
+	Partition* find(const string &username) const;
+
+	//return the partition for username, creating it if needed
+	Partition& findOrCreate(const string &username);
+public:
+	Ledger();
+
+	//load all users' transactions from file
+	void loadFile(const string &filename);
+
+	//save all users' transactions to file
+	void saveFile(const string &filename) const;
+
+	//append every user's rows to out as lines of transactions.csv, each
+	//partition under its read lock
+	void formatRows(string &out) const;
+
+	//call f(const TransactionList&) under username's read lock
+	template<class F>
+	void read(const string &username, F f) const {
+		Partition *partition = find(username);
+		if (!partition) {
+			TransactionList none;
+			f(static_cast<const TransactionList&>(none));
+			return;
+		}
+		std::shared_lock<std::shared_mutex> lock(partition->lock);
+		f(static_cast<const TransactionList&>(partition->rows));
+	}
+
+	//call f(TransactionList&) under username's write lock
+	template<class F>
+	void write(const string &username, F f) {
+		Partition &partition = findOrCreate(username);
+		std::unique_lock<std::shared_mutex> lock(partition.lock);
+		f(partition.rows);
+	}
 };
 
 //represents a user.
@@ -360,35 +1643,188 @@ public:
 
 	User(const string &username, const string &password, bool admin = false);
 
-	void writeToFile(ofstream &ofs) const;
-	void readFromFile(ifstream &ifs);
+	//append the record to buf (see the users.dat layout)
+	void writeTo(string &buf) const;
+	//parse a record at data; return bytes consumed, 0 if truncated
+	size_t readFrom(const char *data, size_t size);
+	//parse a legacy (size_t length prefixed) record; return bytes consumed
+	size_t readLegacy(const char *data, size_t size);
 	static string hash(const string &password);
 
 	bool isAdmin() const;
 	const string& getPassword() const;
 	const string& getUsername() const;
+
+	//heap bytes held by the strings of this user
+	size_t heapBytes() const;
 };
 
-class UserList: public LinkedList<User> {
+//the accounts, in one contiguous array in file order
+class UserList {
+	vector<User> users;
 
 public:
 	UserList();
 
 	bool hasUser(const string &username) const;
 
+	//add an account; the caller checks that the name is free
+	void addUser(const string &username, const string &password, bool admin);
+
 	bool login(const string &username, const string &password,
 			bool &admin) const;
 
 	void loadFile(const string &filename);
 
+	void saveFile(const string &filename) const;
+
+	MemoryUsage memoryUsage(const string &name) const;
+
+private:
+	//read filename without locking it
+	void readFile(const string &filename);
+
+	//parse a version 2 or 3 image held in buf
+	void loadImage(const string &buf);
+
+	//parse the unversioned format written before users.dat version 2
+	void loadLegacy(const string &buf);
+};
+
+//plaintext export formats
+enum ExportFormat {
+	ExportCsv, ExportJsonLines
+};
+
+//row predicates pushed down into the export scan
+struct ExportFilter {
+	string username; //empty for all users
+	uint32_t fromDate; //YYYYMMDD, 0 for no lower bound
+	uint32_t toDate; //YYYYMMDD, 0 for no upper bound
+	int type; //-1 for any
+	int category; //-1 for any
+
+	ExportFilter();
+
+	bool matches(const Transaction &trans) const;
+};
+
+//buffered writer to a file descriptor, formatting numbers with to_chars
+class BufferedWriter {
+	int fd;
+	char buf[1 << 16];
+	size_t used;
+
+public:
+	BufferedWriter(int fd);
+	~BufferedWriter();
+
+	void write(std::string_view text);
+	void write(char c);
+	void writeNumber(double value);
+	void writeNumber(long value);
+
+	//write text as a CSV field, quoted if needed
+	void writeCsvField(std::string_view text);
+
+	//write text as a JSON string literal
+	void writeJsonString(std::string_view text);
+
+	void flush();
+};
+
+//stream the rows of the transaction file source that pass filter to outFd,
+//decrypted, in the given format; return the number of rows written.
+//memory use does not depend on the size of the file.
+size_t exportTransactions(const string &source, const ExportFilter &filter,
+		ExportFormat format, int outFd);
+
+//pass each row of source that filter matches to visit. only the segments
+//the filter can match are read, then the rows appended since the last full
+//save.
+void scanTransactions(const string &source, const ExportFilter &filter,
+		const std::function<void(const Transaction&)> &visit);
+
+//the rows of source that filter matches and whose category, description or
+//date contains keyword, read like scanTransactions
+void searchTransactionFile(const string &source, const ExportFilter &filter,
+		const string &keyword, Queue &queue);
+
+//totals of the rows of source that filter matches, grouped by fields (see
+//GroupField), read like scanTransactions
+void groupTransactionFile(const string &source, const ExportFilter &filter,
+		int fields, vector<GroupTotal> &out);
+
+//counts from parsing a bank statement
+struct ImportResult {
+	size_t parsed; //valid rows
+	size_t invalid; //rows with a bad date or amount
+	size_t imported; //rows appended (set by the caller)
+
+	ImportResult();
+};
+
+//reads plaintext bank statement CSVs. columns are found by header name
+//(date, description, amount, and optionally type and category); without a
+//type column, negative amounts are expenses. lines are validated in
+//parallel batches, without exceptions.
+class StatementImporter {
+private:
+	int dateColumn;
+	int descriptionColumn;
+	int amountColumn;
+	int typeColumn;
+	int categoryColumn;
+
+	//split one CSV line (RFC 4180 quoting) into fields
+	static void splitCsv(std::string_view line, vector<string> &fields);
+
+	//map header names to columns; return false if required ones are missing
+	bool mapColumns(std::string_view header);
+
+	//parse one line into trans; return false if it is invalid
+	bool parseLine(std::string_view line, const string &username,
+			vector<string> &fields, Transaction &trans) const;
+public:
+	StatementImporter();
+
+	//parse filename into rows owned by username
+	ImportResult readFile(const string &filename, const string &username,
+			vector<Transaction> &rows);
+};
+
+//monthly budget definitions of all users, stored in budgets.dat
+class BudgetBook {
+private:
+	map<string, map<int, double>> budgets; //username -> category -> limit
+	unordered_set<string> changedUsers; //users whose budgets this session set
+
+	//parse a budgets.dat image; missing users are added, others replaced
+	void readFile(const string &filename, bool keepChanged);
+public:
+	BudgetBook();
+
+	void loadFile(const string &filename);
+
+	//save, keeping other sessions' changes to users this session left alone
 	void saveFile(const string &filename);
+
+	//fill limits (indexed by category) with username's budgets
+	void getLimits(const string &username,
+			double limits[TRANSACTION_CATEGORY_COUNT]) const;
+
+	//set username's budget for category (0 removes it)
+	void setLimit(const string &username, TransactionCategory category,
+			double limit);
 };
 
 //show menu and handle user commands.
 class App {
 private:
+	SaveWorker saver; //declared first so it outlives transList
 	TransactionList transList;
 	UserList userList;
+	BudgetBook budgets;
 	string currentUser;
 public:
 	//constructor.
@@ -425,42 +1861,424 @@ public:
 	void searchTransaction();
 
 	//display all transactions
-	void displayTransactions() const;
+	void displayTransactions();
 
 	//sort transactions
 	void sortTransactions();
 
+	//show the latest transactions
+	void recentTransactions();
+
+	//show the largest expenses
+	void largestExpenses();
+
+	//prompt for how many rows to show
+	int promptCount();
+
+	//set a monthly budget for an expense category
+	void setBudget();
+
+	//print budget alerts raised by the last command
+	void showAlerts();
+
+	//export transactions as plaintext CSV or JSON Lines
+	void exportTransactions(bool admin);
+
+	//import a bank statement CSV
+	void importStatement();
+
+	//revert or reapply the latest change
+	void undo();
+	void redo();
+
+	//group-by totals over all users' transactions (admin only)
+	void ledgerReport();
+
+	//memory held by each part of the program (admin only)
+	void memoryReport();
+
+	//prompt for an optional date (DD/MM/YYYY); return YYYYMMDD or 0
+	uint32_t promptOptionalDate(const string &prompt);
+
 	//print table header
 	void printTableHeader() const;
 
 	//validate date (DD/MM/YYYY)
-	bool validateDate(const string &input) const;
+	static bool validateDate(const string &input);
 
 	//validate amount (a number)
-	bool validateAmount(const string &input) const;
+	static bool validateAmount(const string &input);
+};
+
+// ledger server protocol (all integers little-endian):
+//   frame    : uint32 length of the rest, then uint8 request type or status
+//   string   : uint16 length, bytes
+//   row      : uint8 type, string date, uint8 category, string description,
+//              float64 amount
+//   Login    : string username, string password -> uint8 admin
+//   Add      : row fields -> (empty)
+//   Modify   : uint32 index, row fields -> (empty)
+//   Delete   : uint32 index -> (empty), admins only
+//   Search   : string keyword -> uint32 count, rows
+//   Sort     : (empty) -> (empty)
+//   List     : (empty) -> uint32 count, rows
+// a failed request answers with a non-OK status and a string message.
+enum RequestType {
+	RequestLogin = 1,
+	RequestAdd,
+	RequestModify,
+	RequestDelete,
+	RequestSearch,
+	RequestSort,
+	RequestList
+};
+
+enum ResponseStatus {
+	StatusOk, StatusError, StatusNotSignedIn, StatusDenied, StatusBadRequest
+};
+
+const size_t MAX_FRAME_SIZE = 1 << 20;
+const int SERVER_WORKERS = 4;
+
+//builds a protocol message
+class MessageWriter {
+	string buf;
+
+public:
+	void putU8(uint8_t value);
+	void putU32(uint32_t value);
+	void putDouble(double value);
+	void putString(const string &value);
+	void putTransaction(const Transaction &trans);
+
+	const string& data() const;
+
+	//return the message as a frame with the given type or status byte
+	string frame(uint8_t code) const;
+};
+
+//parses a protocol message; any read past the end clears ok()
+class MessageReader {
+	const char *data;
+	size_t size;
+	size_t pos;
+	bool valid;
+
+	bool take(void *out, size_t len);
+public:
+	MessageReader(const char *data, size_t size);
+
+	uint8_t getU8();
+	uint32_t getU32();
+	double getDouble();
+	string getString();
+
+	//true if every read so far succeeded and the message was fully read
+	bool done() const;
+	bool ok() const;
+};
+
+//fixed-size pool of threads running queued tasks
+class WorkerPool {
+	vector<std::thread> threads;
+	deque<std::function<void()>> tasks;
+	std::mutex mtx;
+	std::condition_variable ready;
+	bool stopping;
+
+	void run();
+public:
+	WorkerPool(int threadCount);
+	~WorkerPool();
+
+	void submit(std::function<void()> task);
+};
+
+//long-running server keeping the ledger and users resident and serving
+//requests over a Unix domain socket (epoll loop plus a worker pool).
+class LedgerServer {
+private:
+	struct Connection {
+		int fd;
+		string in; //bytes received, not yet dispatched
+		string out; //bytes waiting to be sent
+		bool busy; //a request is on a worker
+		bool closing; //closed while busy; the fd is released on completion
+		string username; //signed in user, empty if none
+		bool admin;
+	};
+
+	struct Completion {
+		int fd;
+		string response;
+		string username;
+		bool admin;
+	};
+
+	string socketPath;
+	string transFile;
+	Ledger ledger;
+	UserList users;
+	int epollFd;
+	int listenFd;
+	int wakeFd; //eventfd: workers finished or shutdown requested
+	map<int, Connection> connections; //only touched by the loop thread
+	std::mutex completedLock;
+	vector<Completion> completed;
+	SaveWorker saver; //writes the ledger after changes
+	WorkerPool pool;
+
+	void acceptConnections();
+	void readConnection(Connection &conn);
+	void dispatch(Connection &conn);
+	void writeConnection(Connection &conn);
+	void finishRequests();
+
+	//close fd, or only stop watching it while a worker still holds it, so
+	//its number cannot go to a new client before the answer comes back
+	void closeConnection(int fd);
+
+	//queue a save of the whole ledger with the autosave worker
+	void changed();
+
+	//run one request on a worker thread; updates the session on login
+	string handle(const string &request, string &username, bool &admin);
+	//handle a request, throwing on failures handle turns into replies
+	string handleRequest(int type, MessageReader &reader, string &username,
+			bool &admin);
+	string handleRow(MessageReader &reader, const string &username,
+			Transaction &trans);
+public:
+	LedgerServer(const string &socketPath, const string &transFile,
+			const string &userFile);
+	~LedgerServer();
+
+	//serve until SIGINT or SIGTERM, then save the ledger. changes are
+	//saved in the background, AUTOSAVE_INTERVAL_MS after the first or once
+	//AUTOSAVE_DIRTY_ROWS have piled up.
+	void run();
+};
+
+//blocking client for the ledger server
+class LedgerClient {
+	int fd;
+
+public:
+	LedgerClient();
+	~LedgerClient();
+
+	void connectTo(const string &socketPath);
+
+	//send one request and wait for its response
+	ResponseStatus call(RequestType type, const MessageWriter &request,
+			string &response);
 };
 
-int main() {
+//sign in to the ledger server at socketPath and send requests from a menu
+void runClient(const string &socketPath);
+
+//time the hot paths on a synthetic ledger of the given size
+void runBenchmarks(int rows);
+
+int main(int argc, char *argv[]) {
+	if (argc >= 2 && string(argv[1]) == "--bench") {
+		try {
+			runBenchmarks(argc >= 3 ? atoi(argv[2]) : 1000000);
+		} catch (const exception &e) {
+			cout << "Exception: " << e.what() << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc == 3 && string(argv[1]) == "--client") {
+		try {
+			runClient(argv[2]);
+		} catch (const exception &e) {
+			cout << "Exception: " << e.what() << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc == 3 && string(argv[1]) == "--server") {
+		try {
+			LedgerServer server(argv[2], TRANS_FILENAME, USER_FILENAME);
+			server.run();
+		} catch (const exception &e) {
+			cout << "Exception: " << e.what() << endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	App app;
 	app.runMenu();
 }
 
+AllocationCounters::AllocationCounters() :
+		allocations(0), releases(0), systemAllocations(0), systemBytes(0), liveBytes(
+				0), heldBytes(0) {
+}
+
+void AllocationCounters::print(const string &name) const {
+	cout << name << ": " << allocations << " nodes allocated, " << releases
+			<< " released, " << systemAllocations << " heap blocks ("
+			<< systemBytes / 1024 << " KiB), " << liveBytes / 1024
+			<< " KiB live, " << heldBytes / 1024 << " KiB held" << endl;
+}
+
+size_t AllocationCounters::nodeBytes() const {
+	uint64_t nodes = allocations - releases;
+	return nodes > 0 ? liveBytes / nodes : 0;
+}
+
+MemoryUsage::MemoryUsage(const string &name, size_t objects, size_t bytes,
+		bool perRow) :
+		name(name), objects(objects), bytes(bytes), perRow(perRow) {
+}
+
+size_t heapBytes(const string &text) {
+	//short strings live inside the string object
+	return text.capacity() > 15 ? text.capacity() + 1 : 0;
+}
+
+void printMemoryUsage(const vector<MemoryUsage> &usage, size_t transactions) {
+	size_t total = 0, rowBytes = 0;
+	cout.setf(ios::left);
+	cout << setw(20) << "Part" << setw(12) << "Objects" << "KiB" << endl;
+	for (const MemoryUsage &part : usage) {
+		cout << setw(20) << part.name << setw(12) << part.objects
+				<< (part.bytes + 1023) / 1024 << endl;
+		total += part.bytes;
+		if (part.perRow) {
+			rowBytes += part.bytes;
+		}
+	}
+	cout << setw(32) << "total" << (total + 1023) / 1024 << endl;
+	cout.unsetf(ios::left);
+	if (transactions > 0) {
+		cout << "bytes per transaction: " << rowBytes / transactions << " ("
+				<< transactions << " transactions)" << endl;
+	}
+}
+
+AllocationCounters& HeapPolicy::counters() {
+	static AllocationCounters counters;
+	return counters;
+}
+
+AllocationCounters& PoolPolicy::counters() {
+	static AllocationCounters counters;
+	return counters;
+}
+
+AllocationCounters& ArenaPolicy::counters() {
+	static AllocationCounters counters;
+	return counters;
+}
+
+NodePool::NodePool(size_t size) :
+		freeList(nullptr), slab(nullptr), slabLeft(0) {
+	//every block must hold a free list link and keep nodes aligned
+	const size_t align = alignof(std::max_align_t);
+	blockSize = (std::max(size, sizeof(FreeBlock)) + align - 1) / align * align;
+}
+
+NodePool& NodePool::forSize(size_t size) {
+	static std::mutex poolsLock;
+	static map<size_t, NodePool*> pools;
+	std::lock_guard<std::mutex> guard(poolsLock);
+	NodePool *&pool = pools[size];
+	if (!pool) {
+		pool = new NodePool(size);
+	}
+	return *pool;
+}
+
+void* NodePool::allocate() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (freeList) {
+		FreeBlock *block = freeList;
+		freeList = block->next;
+		return block;
+	}
+	if (slabLeft < blockSize) {
+		size_t size = std::max(SLAB_SIZE, blockSize);
+		slab = (char*) ::operator new(size);
+		slabs.push_back(slab);
+		slabLeft = size;
+		PoolPolicy::counters().systemAllocations++;
+		PoolPolicy::counters().systemBytes += size;
+		PoolPolicy::counters().heldBytes += size;
+	}
+	void *block = slab;
+	slab += blockSize;
+	slabLeft -= blockSize;
+	return block;
+}
+
+void NodePool::deallocate(void *block) {
+	std::lock_guard<std::mutex> guard(lock);
+	FreeBlock *link = (FreeBlock*) block;
+	link->next = freeList;
+	freeList = link;
+}
+
+NodeArena::NodeArena() :
+		next(nullptr), left(0), blockSize(FIRST_BLOCK_SIZE), totalSize(0) {
+}
+
+NodeArena::~NodeArena() {
+	for (char *block : blocks) {
+		::operator delete(block);
+	}
+	ArenaPolicy::counters().heldBytes -= totalSize;
+}
+
+void* NodeArena::allocate(size_t size, size_t align) {
+	size_t pad = (align - (uintptr_t) next % align) % align;
+	if (left < size + pad) {
+		//blocks double up to MAX_BLOCK_SIZE, so a big result set needs few
+		while (blockSize < size + align) {
+			blockSize *= 2;
+		}
+		next = (char*) ::operator new(blockSize);
+		blocks.push_back(next);
+		left = blockSize;
+		totalSize += blockSize;
+		ArenaPolicy::counters().systemAllocations++;
+		ArenaPolicy::counters().systemBytes += blockSize;
+		ArenaPolicy::counters().heldBytes += blockSize;
+		blockSize = std::min(blockSize * 2, std::max(MAX_BLOCK_SIZE, blockSize));
+		pad = (align - (uintptr_t) next % align) % align;
+	}
+	void *p = next + pad;
+	next += pad + size;
+	left -= pad + size;
+	return p;
+}
+
 Transaction::Transaction() :
 		type(Income), date(""), category(Other), description(""), amount(0) {
 
 }
 
-Transaction::Transaction(const string &username, TransactionType type,
-		const string &date, TransactionCategory category,
-		const string &description, double amount) :
-		username(username), type(type), date(date), category(category), description(
-				description), amount(amount) {
+Transaction::Transaction(string username, TransactionType type, string date,
+		TransactionCategory category, string description, double amount) :
+		username(std::move(username)), type(type), date(std::move(date)), category(
+				category), description(std::move(description)), amount(amount) {
 }
 
 const string& Transaction::getUsername() const {
 	return username;
 }
 
+size_t Transaction::heapBytes() const {
+	return ::heapBytes(username) + ::heapBytes(date)
+			+ ::heapBytes(description);
+}
+
 //print transaction
 void Transaction::print() const {
 	cout.setf(ios::left);
@@ -480,38 +2298,18 @@ double Transaction::getAmount() const {
 	return amount;
 }
 
-string Transaction::getType() const {
-	switch (type) {
-	case Income:
-		return "Income";
-	case Expense:
-		return "Expense";
-	default:
-		return "";
+std::string_view Transaction::getType() const {
+	if (type >= 0 && type < TRANSACTION_TYPE_COUNT) {
+		return TYPE_NAMES[type];
 	}
+	return "";
 }
 
-string Transaction::getCategory() const {
-	switch (category) {
-	case Salary:
-		return "Salary";
-	case Cash:
-		return "Cash";
-	case Gift:
-		return "Gift";
-	case Food:
-		return "Food";
-	case Clothes:
-		return "Clothes";
-	case Transportation:
-		return "Transportation";
-	case Entertainment:
-		return "Entertainment";
-	case Communication:
-		return "Communication";
-	default:
-		return "Other";
+std::string_view Transaction::getCategory() const {
+	if (category >= 0 && category < TRANSACTION_CATEGORY_COUNT) {
+		return CATEGORY_NAMES[category];
 	}
+	return CATEGORY_NAMES[Other];
 }
 
 const string& Transaction::getDate() const {
@@ -539,6 +2337,24 @@ string Transaction::getDateForCompare() const {
 	return oss.str();
 }
 
+//get date as the integer YYYYMMDD
+uint32_t Transaction::getDateKey() const {
+	if (date.size() < 10) {
+		return 0;
+	}
+	auto digits = [this](size_t pos, size_t len) {
+		uint32_t value = 0;
+		for (size_t i = pos; i < pos + len; i++) {
+			if (date[i] < '0' || date[i] > '9') {
+				break;
+			}
+			value = value * 10 + (date[i] - '0');
+		}
+		return value;
+	};
+	return digits(6, 4) * 10000 + digits(3, 2) * 100 + digits(0, 2);
+}
+
 void Transaction::setAmount(double amount) {
 	this->amount = amount;
 }
@@ -563,432 +2379,5536 @@ const string& Transaction::getDescription() const {
 	return description;
 }
 
-TransactionType Transaction::getTypeInt() const {
-	return type;
+string formatTransaction(const Transaction &trans) {
+	ostringstream oss;
+	oss << trans.getUsername() << ",";
+	oss << trans.getTypeInt() << ",";
+	oss << trans.getDate() << ",";
+	oss << trans.getCategoryInt() << ",";
+	oss << trans.getDescription() << ",";
+	//shortest text that reads back as the same amount
+	char digits[32];
+	std::to_chars_result result = std::to_chars(digits,
+			digits + sizeof(digits), trans.getAmount());
+	oss.write(digits, result.ptr - digits);
+	return oss.str();
 }
-TransactionCategory Transaction::getCategoryInt() const {
-	return category;
+
+bool Transaction::readLine(const string &plain) {
+	//fields: username,type,date,category,description,amount
+	size_t commas[5];
+	size_t pos = 0;
+	for (size_t &comma : commas) {
+		comma = plain.find(',', pos);
+		if (comma == string::npos) {
+			return false;
+		}
+		pos = comma + 1;
+	}
+	if (pos >= plain.size()) {
+		return false;
+	}
+
+	//the enums index name tables and fill bit fields, so reject anything
+	//out of range before it is stored
+	int typeValue = atoi(plain.c_str() + commas[0] + 1);
+	int categoryValue = atoi(plain.c_str() + commas[2] + 1);
+	if ((typeValue != Income && typeValue != Expense) || categoryValue < 0
+			|| categoryValue >= TRANSACTION_CATEGORY_COUNT) {
+		return false;
+	}
+
+	username.assign(plain, 0, commas[0]);
+	type = (TransactionType) typeValue;
+	date.assign(plain, commas[1] + 1, commas[2] - commas[1] - 1);
+	category = (TransactionCategory) categoryValue;
+	description.assign(plain, commas[3] + 1, commas[4] - commas[3] - 1);
+	amount = atof(plain.c_str() + pos);
+	return true;
 }
 
-TransactionList::TransactionList() {
+bool isOwnedBy(const string &line, const string &username) {
+	return line.size() > username.size()
+			&& line.compare(0, username.size(), username) == 0
+			&& line[username.size()] == ',';
 }
 
-void TransactionList::setCurrentUser(const string &username) {
-	currentUser = username;
+static uint32_t crc32cTable(uint32_t crc, const char *data, size_t size) {
+	static const vector<uint32_t> table = [] {
+		vector<uint32_t> t(256);
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) {
+				c = (c >> 1) ^ (c & 1 ? 0x82F63B78 : 0);
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+	for (size_t i = 0; i < size; i++) {
+		crc = table[(crc ^ (uint8_t) data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
 }
 
-void TransactionList::loadFile(const string &filename) {
-	string username;
-	int type;
-	string date; // format: "DD/MM/YYYY"
-	int category; //Housing, Transportation, Food
-	string description;
-	double amount; //positive or negative float value
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const char *data, size_t size) {
+	uint64_t c = crc;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		c = _mm_crc32_u64(c, word);
+	}
+	uint32_t c32 = c;
+	for (; i < size; i++) {
+		c32 = _mm_crc32_u8(c32, data[i]);
+	}
+	return c32;
+}
 
-	//open file
-	ifstream ifs(filename);
+static const bool cpuHasSse42 = __builtin_cpu_supports("sse4.2");
+#endif
 
-	//check file exists or not.
-	if (ifs.is_open()) {
+uint32_t crc32c(const char *data, size_t size, uint32_t crc) {
+	crc = ~crc;
+#if defined(__x86_64__)
+	if (cpuHasSse42) {
+		return ~crc32cSse42(crc, data, size);
+	}
+#endif
+	return ~crc32cTable(crc, data, size);
+}
 
-		clear();
-		others.clear();
+string checksumLine(const string &text) {
+	ostringstream oss;
+	oss << CHECKSUM_TAG << ' ' << CHECKSUM_VERSION << ' '
+			<< CHECKSUM_BLOCK_SIZE << ' ' << text.size() << hex;
+	for (size_t pos = 0; pos < text.size(); pos += CHECKSUM_BLOCK_SIZE) {
+		oss << ' '
+				<< crc32c(text.data() + pos,
+						std::min(CHECKSUM_BLOCK_SIZE, text.size() - pos));
+	}
+	return oss.str() + '\n';
+}
 
-		string line;
+//check whether line starts with tag and a space
+static bool hasTag(std::string_view line, const string &tag) {
+	return line.size() > tag.size() && line.compare(0, tag.size(), tag) == 0
+			&& line[tag.size()] == ' ';
+}
+
+bool isChecksumLine(const string &line) {
+	return hasTag(line, CHECKSUM_TAG);
+}
 
-		while (getline(ifs, line)) {
-			line = decrypt(line);
+bool isSegmentLine(const string &line) {
+	return hasTag(line, SEGMENT_TAG);
+}
 
-			string temp;
-			istringstream iss(line);
+//read and decrypt a whole transactions file; if verify is set, check a
+//sealed file against its last checksum line
+static string openPlainImage(string &&image, const string &filename,
+		bool verify);
 
-			getline(iss, username, ',');
-			getline(iss, temp, ',');
-			type = atoi(temp.c_str());
-			getline(iss, date, ',');
-			getline(iss, temp, ',');
-			category = atoi(temp.c_str());
-			getline(iss, description, ',');
-			getline(iss, temp);
-			amount = atof(temp.c_str());
-
-			if (!iss.fail()) {
-				//create object and add to array
-				Transaction trans(username, (TransactionType) type, date,
-						(TransactionCategory) category, description, amount);
-
-				if (username == currentUser) {
-					addToTail(trans);
-				} else {
-					others.addToTail(trans);
-				}
-			}
-		}
-		ifs.close();
+static string readPlainFile(const string &filename, bool verify) {
+	string image;
+	if (!readFileImage(filename, image)) {
+		throw FileException("Failed to open file " + filename + ".");
+	}
+	return openPlainImage(std::move(image), filename, verify);
+}
+
+//decrypt and verify a transactions file image read by the caller
+static string openPlainImage(string &&image, const string &filename,
+		bool verify) {
+	bool sealed;
+	string text = openSealed(std::move(image), filename, sealed);
 
-		cout << "loaded " << size() << " transactions from " << filename << "."
-				<< endl;
+	//the last checksum line covers everything before it; older files have
+	//none, and old-format files were checksummed before decoding
+	if (!verify || !sealed) {
+		return text;
+	}
+	const string marker = CHECKSUM_TAG + " ";
+	size_t pos = text.rfind(marker);
+	while (pos != string::npos && pos > 0 && text[pos - 1] != '\n') {
+		pos = text.rfind(marker, pos - 1);
+	}
+	if (pos == string::npos) {
+		return text;
+	}
+
+	size_t end = text.find('\n', pos);
+	string line = text.substr(pos,
+			(end == string::npos ? text.size() : end) - pos);
+	istringstream iss(line.substr(CHECKSUM_TAG.size()));
+	int version = 0;
+	size_t blockSize = 0, length = 0;
+	iss >> version >> blockSize >> length >> hex;
+
+	size_t damaged = 0;
+	if (!iss || version != CHECKSUM_VERSION || blockSize == 0
+			|| length != pos) {
+		damaged = 1;
 	} else {
+		for (size_t block = 0; block < length; block += blockSize) {
+			uint32_t expected;
+			if (!(iss >> expected)
+					|| crc32c(text.data() + block,
+							std::min(blockSize, length - block))
+							!= expected) {
+				damaged++;
+			}
+		}
+	}
+	//refuse damaged text: a save of what still parses would make the loss
+	//permanent
+	if (damaged > 0) {
 		ostringstream oss;
-		oss << "Failed to open file " << filename << ".";
-
+		oss << filename << " failed its integrity check (" << damaged
+				<< " damaged blocks).";
 		throw FileException(oss.str());
 	}
+	return text;
 }
 
-void TransactionList::saveFile(const string &filename) const {
-	//create file
-	ofstream ofs(filename);
+//write all of data to fd; return false on error
+static bool writeFully(int fd, const string &data) {
+	size_t written = 0;
+	while (written < data.size()) {
+		ssize_t n = write(fd, data.data() + written, data.size() - written);
+		if (n < 0) {
+			return false;
+		}
+		written += n;
+	}
+	return true;
+}
 
-	if (ofs.is_open()) {
-		//output all transactions to file
-		std::shared_ptr<Node> node = head;
-		while (node) {
-			ostringstream oss;
-			oss << node->data.getUsername() << ",";
-			oss << node->data.getTypeInt() << ",";
-			oss << node->data.getDate() << ",";
-			oss << node->data.getCategoryInt() << ",";
-			oss << node->data.getDescription() << ",";
-			oss << node->data.getAmount();
-
-			string line = oss.str();
-			line = encrypt(line);
-			ofs << line << endl;
-			node = node->next;
+//the key of the transactions files, created on first use
+static const unsigned char* ledgerKey() {
+	static unsigned char key[SEALED_KEY_SIZE];
+	static std::once_flag loaded;
+	std::call_once(loaded, [] {
+		int fd = open(KEY_FILENAME.c_str(), O_RDONLY);
+		if (fd < 0 && errno == ENOENT) {
+			//first run: make a random key only this user can read
+			unsigned char fresh[SEALED_KEY_SIZE];
+			if (RAND_bytes(fresh, sizeof(fresh)) != 1) {
+				throw FileException("Failed to generate a key.");
+			}
+			int out = open(KEY_FILENAME.c_str(), O_WRONLY | O_CREAT | O_EXCL,
+					0600);
+			if (out >= 0) {
+				bool ok = writeFully(out,
+						string((const char*) fresh, sizeof(fresh)))
+						&& fsync(out) == 0;
+				close(out);
+				if (!ok) {
+					unlink(KEY_FILENAME.c_str());
+					throw FileException("Failed to write " + KEY_FILENAME + ".");
+				}
+			}
+			//another process may have created it first; use whichever won
+			fd = open(KEY_FILENAME.c_str(), O_RDONLY);
+		}
+		if (fd < 0 || read(fd, key, sizeof(key)) != (ssize_t) sizeof(key)) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			throw FileException("Failed to read " + KEY_FILENAME + ".");
+		}
+		close(fd);
+	});
+	return key;
+}
+
+//AES-256-GCM context for one thread
+class ChunkCipher {
+private:
+	EVP_CIPHER_CTX *ctx;
+	bool encrypting;
+public:
+	explicit ChunkCipher(bool encrypting) :
+			ctx(EVP_CIPHER_CTX_new()), encrypting(encrypting) {
+		if (!ctx
+				|| (encrypting ?
+						EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr,
+								ledgerKey(), nullptr) :
+						EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr,
+								ledgerKey(), nullptr)) != 1) {
+			EVP_CIPHER_CTX_free(ctx);
+			throw FileException("Failed to set up encryption.");
 		}
+	}
 
-		others.saveFile(ofs);
-		ofs.close();
+	~ChunkCipher() {
+		EVP_CIPHER_CTX_free(ctx);
+	}
 
-		cout << "saved " << size() << " transactions to " << filename << "."
-				<< endl;
-	} else {
+	ChunkCipher(const ChunkCipher&) = delete;
+	ChunkCipher& operator=(const ChunkCipher&) = delete;
+
+	//encrypt size bytes of in to out and write the tag; aad (see chunkAad)
+	//is authenticated with the chunk
+	void seal(const unsigned char *nonce, const string &aad, const char *in,
+			size_t size, char *out, unsigned char *tag) {
+		int len;
+		if (EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) != 1
+				|| EVP_EncryptUpdate(ctx, nullptr, &len,
+						(const unsigned char*) aad.data(), aad.size()) != 1
+				|| EVP_EncryptUpdate(ctx, (unsigned char*) out, &len,
+						(const unsigned char*) in, size) != 1
+				|| EVP_EncryptFinal_ex(ctx, (unsigned char*) out + len, &len)
+						!= 1
+				|| EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG,
+						SEALED_TAG_SIZE, tag) != 1) {
+			throw FileException("Failed to encrypt.");
+		}
+	}
 
-		ostringstream oss;
-		oss << "Failed to create file " << filename << ".";
-		throw FileException(oss.str());
+	//decrypt size bytes of in to out; return false if the tag does not match
+	bool open(const unsigned char *nonce, const string &aad, const char *in,
+			size_t size, char *out, const unsigned char *tag) {
+		int len;
+		return EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1
+				&& EVP_DecryptUpdate(ctx, nullptr, &len,
+						(const unsigned char*) aad.data(), aad.size()) == 1
+				&& EVP_DecryptUpdate(ctx, (unsigned char*) out, &len,
+						(const unsigned char*) in, size) == 1
+				&& EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG,
+						SEALED_TAG_SIZE, (void*) tag) == 1
+				&& EVP_DecryptFinal_ex(ctx, (unsigned char*) out + len, &len)
+						== 1;
+	}
+};
+
+//the data authenticated with chunk index of a file of the given version,
+//whose length field is lengthField
+static string chunkAad(uint32_t version, uint64_t index, uint32_t lengthField) {
+	string aad(SEALED_FILE_MAGIC, sizeof(SEALED_FILE_MAGIC));
+	aad.append((const char*) &version, sizeof(version));
+	if (version >= 2) {
+		aad.append((const char*) &index, sizeof(index));
+		aad.append((const char*) &lengthField, sizeof(lengthField));
 	}
+	return aad;
 }
 
-// prompt user to select an transaction
-int TransactionList::selectTransaction() {
-	string temp;
-	int index;
+string sealText(const string &text, uint64_t firstChunk) {
+	string out;
+	out.reserve(text.size() + SEALED_HEADER_SIZE
+			+ (text.size() / SEALED_CHUNK_SIZE + 1)
+					* (4 + SEALED_NONCE_SIZE + SEALED_TAG_SIZE));
+	if (firstChunk == 0) {
+		out.append(SEALED_FILE_MAGIC, sizeof(SEALED_FILE_MAGIC));
+		out.append((const char*) &SEALED_FILE_VERSION,
+				sizeof(SEALED_FILE_VERSION));
+		uint32_t chunkSize = SEALED_CHUNK_SIZE;
+		out.append((const char*) &chunkSize, sizeof(chunkSize));
+		out.append(4, '\0');
+	}
 
-	displayTransactions();
-	cout << "Your selection: ";
+	//the last chunk is marked, so a file cut after a whole chunk fails too;
+	//empty text still gets one (empty) chunk to carry the mark
+	ChunkCipher cipher(true);
+	size_t pos = 0;
+	uint64_t index = firstChunk;
+	do {
+		//end chunks after a line, so chunks hold whole rows
+		size_t size = text.size() - pos;
+		if (size > SEALED_CHUNK_SIZE) {
+			size_t nl = text.rfind('\n', pos + SEALED_CHUNK_SIZE - 1);
+			size = nl != string::npos && nl >= pos ?
+					nl + 1 - pos : SEALED_CHUNK_SIZE;
+		}
 
-	getline(cin, temp);
-	index = atoi(temp.c_str());
-	while (!(index >= 1 && index <= size())) {
-		cout << "Your selection: ";
-		getline(cin, temp);
-		index = atoi(temp.c_str());
+		uint32_t length = size;
+		if (pos + size == text.size()) {
+			length |= SEALED_FINAL_CHUNK;
+		}
+		unsigned char nonce[SEALED_NONCE_SIZE];
+		if (RAND_bytes(nonce, sizeof(nonce)) != 1) {
+			throw FileException("Failed to generate a nonce.");
+		}
+		out.append((const char*) &length, sizeof(length));
+		out.append((const char*) nonce, sizeof(nonce));
+		size_t cipherPos = out.size();
+		out.resize(cipherPos + size + SEALED_TAG_SIZE);
+		cipher.seal(nonce, chunkAad(SEALED_FILE_VERSION, index++, length),
+				text.data() + pos, size, &out[cipherPos],
+				(unsigned char*) &out[cipherPos + size]);
+		pos += size;
+	} while (pos < text.size());
+	return out;
+}
+
+//version in the header of a sealed file image; throws for versions this
+//program cannot read
+static uint32_t sealedVersion(const char *header, const string &filename) {
+	uint32_t version;
+	memcpy(&version, header + sizeof(SEALED_FILE_MAGIC), sizeof(version));
+	if (version < 1 || version > SEALED_FILE_VERSION) {
+		throw FileException(filename + " has an unknown format version.");
 	}
+	return version;
+}
 
-	return index - 1;
+//the error for a sealed file that fails its checks
+static FileException damagedFile(const string &filename, size_t damaged) {
+	ostringstream oss;
+	oss << filename << " has " << damaged
+			<< " damaged or missing encrypted chunks; refusing to load it.";
+	return FileException(oss.str());
 }
 
-void TransactionList::addTransaction(const Transaction &trans) {
-	addToTail(trans);
+//run work(0) .. work(threadCount - 1), work(0) on this thread and the rest
+//on their own. every thread is joined before the first exception any of
+//them threw is rethrown here, so a failing worker cannot end the program.
+static void runParallel(size_t threadCount,
+		const std::function<void(size_t)> &work) {
+	vector<std::exception_ptr> errors(threadCount);
+	auto guarded = [&](size_t t) {
+		try {
+			work(t);
+		} catch (...) {
+			errors[t] = std::current_exception();
+		}
+	};
+	vector<std::thread> threads;
+	try {
+		for (size_t t = 1; t < threadCount; t++) {
+			threads.emplace_back(guarded, t);
+		}
+	} catch (...) {
+		//out of threads: the shares not started run on this one
+	}
+	guarded(0);
+	for (size_t t = threads.size() + 1; t < threadCount; t++) {
+		guarded(t);
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	for (const std::exception_ptr &error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
 }
 
-void TransactionList::modifyTransaction(int index, const Transaction &trans) {
-	if (!(index >= 0 && index < size())) {
-		throw "Invalid transaction index.";
+string openSealed(string &&image, const string &filename, bool &sealed) {
+	sealed = image.size() >= SEALED_HEADER_SIZE
+			&& memcmp(image.data(), SEALED_FILE_MAGIC,
+					sizeof(SEALED_FILE_MAGIC)) == 0;
+	if (!sealed) {
+		decodeLegacy(&image[0], image.size());
+		return std::move(image);
 	}
 
-	set(index, trans);
-}
+	//find the chunks; plaintext is as long as the ciphertext
+	struct Chunk {
+		size_t offset; //of the nonce in image
+		size_t plainOffset;
+		uint32_t lengthField; //length and final mark as stored
+		uint32_t length;
+		bool damaged;
+	};
+	uint32_t version = sealedVersion(image.data(), filename);
+	vector<Chunk> chunks;
+	size_t pos = SEALED_HEADER_SIZE, plainSize = 0;
+	size_t damaged = 0;
+	while (pos < image.size()) {
+		uint32_t field;
+		if (image.size() - pos < sizeof(field)) {
+			damaged++;
+			break;
+		}
+		memcpy(&field, image.data() + pos, sizeof(field));
+		pos += sizeof(field);
+		uint32_t length = version >= 2 ? field & ~SEALED_FINAL_CHUNK : field;
+		if (image.size() - pos < SEALED_NONCE_SIZE + length + SEALED_TAG_SIZE) {
+			//cut short, e.g. by a crash during an append
+			damaged++;
+			break;
+		}
+		chunks.push_back( { pos, plainSize, field, length, false });
+		plainSize += length;
+		pos += SEALED_NONCE_SIZE + length + SEALED_TAG_SIZE;
+	}
+	//a version 2 file ends with the last chunk of a write
+	if (version >= 2 && damaged == 0
+			&& (chunks.empty()
+					|| !(chunks.back().lengthField & SEALED_FINAL_CHUNK))) {
+		damaged++;
+	}
 
-void TransactionList::deleteTransaction(int index) {
-	if (!(index >= 0 && index < size())) {
-		throw "Invalid transaction index.";
+	//chunks are independent: split them across threads for large files
+	string text(plainSize, '\0');
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, plainSize / (4 * SEALED_CHUNK_SIZE) + 1);
+	threadCount = std::min(threadCount, std::max<size_t>(chunks.size(), 1));
+	runParallel(threadCount, [&](size_t t) {
+		ChunkCipher cipher(false);
+		for (size_t i = t; i < chunks.size(); i += threadCount) {
+			Chunk &chunk = chunks[i];
+			const char *nonce = image.data() + chunk.offset;
+			const char *in = nonce + SEALED_NONCE_SIZE;
+			chunk.damaged = !cipher.open((const unsigned char*) nonce,
+					chunkAad(version, i, chunk.lengthField), in, chunk.length,
+					&text[chunk.plainOffset],
+					(const unsigned char*) in + chunk.length);
+		}
+	});
+
+	for (const Chunk &chunk : chunks) {
+		if (chunk.damaged) {
+			damaged++;
+		}
 	}
+	if (damaged > 0) {
+		throw damagedFile(filename, damaged);
+	}
+	return text;
+}
 
-	//remove transaction at index
-	remove(index);
+//read exactly size bytes unless the file ends; return the bytes read
+static size_t readFully(int fd, char *data, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = read(fd, data + done, size - done);
+		if (n < 0) {
+			throw FileException("Failed to read file.");
+		}
+		if (n == 0) {
+			break;
+		}
+		done += n;
+	}
+	return done;
 }
 
-static string toLower(const string &str) {
-	string temp;
+void streamTransactionFile(const string &filename,
+		const std::function<void(const char*, size_t)> &sink) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw FileException("Failed to open file " + filename + ".");
+	}
 
-	for (size_t i = 0; i < str.size(); i++) {
-		if (str[i] >= 'A' && str[i] <= 'Z') {
-			temp += (char) (str[i] + 'a' - 'A');
+	vector<char> buf(SEALED_CHUNK_SIZE + SEALED_NONCE_SIZE + SEALED_TAG_SIZE);
+	vector<char> plain(SEALED_CHUNK_SIZE);
+	try {
+		char header[SEALED_HEADER_SIZE];
+		size_t n = readFully(fd, header, sizeof(header));
+		if (n < sizeof(header)
+				|| memcmp(header, SEALED_FILE_MAGIC, sizeof(SEALED_FILE_MAGIC))
+						!= 0) {
+			//old format: decode fixed-size blocks
+			sink((decodeLegacy(header, n), header), n);
+			while ((n = readFully(fd, buf.data(), buf.size())) > 0) {
+				decodeLegacy(buf.data(), n);
+				sink(buf.data(), n);
+			}
 		} else {
-			temp += str[i];
+			//stop at the first bad chunk; what was passed on is intact
+			uint32_t version = sealedVersion(header, filename);
+			ChunkCipher cipher(false);
+			uint32_t field = 0;
+			uint64_t index = 0;
+			size_t n;
+			while ((n = readFully(fd, (char*) &field, sizeof(field))) > 0) {
+				uint32_t length =
+						version >= 2 ? field & ~SEALED_FINAL_CHUNK : field;
+				size_t recordSize = SEALED_NONCE_SIZE + length + SEALED_TAG_SIZE;
+				const char *in = buf.data() + SEALED_NONCE_SIZE;
+				if (n < sizeof(field) || length > SEALED_CHUNK_SIZE
+						|| readFully(fd, buf.data(), recordSize) < recordSize
+						|| !cipher.open((const unsigned char*) buf.data(),
+								chunkAad(version, index++, field), in, length,
+								plain.data(),
+								(const unsigned char*) in + length)) {
+					throw damagedFile(filename, 1);
+				}
+				sink(plain.data(), length);
+			}
+			if (version >= 2 && !(field & SEALED_FINAL_CHUNK)) {
+				throw damagedFile(filename, 1);
+			}
 		}
+	} catch (...) {
+		close(fd);
+		throw;
 	}
-
-	return temp;
+	close(fd);
 }
 
-void TransactionList::searchTransaction(const string &keyword, Queue &queue) {
-	string lowercase = toLower(keyword);
+void appendTransactionText(const string &filename, const string &text) {
+	int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (fd < 0) {
+		throw FileException("Failed to create file " + filename + ".");
+	}
 
-	std::shared_ptr<Node> node = head;
-	while (node) {
-		if (node->data.getDate().find(lowercase) != string::npos
-				|| toLower(node->data.getCategory()).find(lowercase)
-						!= string::npos) {
-			queue.push(node->data);
+	struct stat st;
+	char header[SEALED_HEADER_SIZE];
+	bool convert = false;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		convert = pread(fd, header, sizeof(header), 0) != (ssize_t) sizeof(header)
+				|| memcmp(header, SEALED_FILE_MAGIC, sizeof(SEALED_FILE_MAGIC))
+						!= 0;
+		if (!convert) {
+			uint32_t version;
+			memcpy(&version, header + sizeof(SEALED_FILE_MAGIC),
+					sizeof(version));
+			convert = version != SEALED_FILE_VERSION;
 		}
-		node = node->next;
 	}
+	if (convert) {
+		//old-format or version 1 file: seal what it holds before adding to
+		//it (a damaged file throws here and is left alone)
+		close(fd);
+		replaceFile(filename, sealText(readPlainFile(filename, false)));
+		fd = open(filename.c_str(), O_RDWR | O_APPEND);
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			throw FileException("Failed to open file " + filename + ".");
+		}
+	}
+
+	//the new chunks are numbered on from the last one in the file, which
+	//must end exactly where the file does
+	uint64_t chunks = 0;
+	off_t pos = st.st_size > 0 ? SEALED_HEADER_SIZE : 0;
+	while (pos < st.st_size) {
+		uint32_t field;
+		if (pread(fd, &field, sizeof(field), pos) != (ssize_t) sizeof(field)) {
+			close(fd);
+			throw damagedFile(filename, 1);
+		}
+		pos += sizeof(field) + SEALED_NONCE_SIZE
+				+ (field & ~SEALED_FINAL_CHUNK) + SEALED_TAG_SIZE;
+		chunks++;
+	}
+	if (pos != st.st_size) {
+		close(fd);
+		throw damagedFile(filename, 1);
+	}
+
+	string data = sealText(text, chunks);
+	if (!writeFully(fd, data)) {
+		close(fd);
+		throw FileException("Failed to write file " + filename + ".");
+	}
+	if (fsync(fd) != 0) {
+		close(fd);
+		throw FileException("Failed to sync file " + filename + ".");
+	}
+	close(fd);
 }
 
-void TransactionList::displayTransactions() const {
-	std::shared_ptr<Node> node = head;
-	int i = 0;
-	while (node) {
-		cout.setf(ios::right);
-		cout << setw(2) << (i + 1) << ". ";
-		cout.unsetf(ios::right);
-		node->data.print();
+SegmentInfo::SegmentInfo() :
+		fromDate(0), toDate(0), rows(0) {
+}
 
-		node = node->next;
-		i++;
+bool SegmentInfo::mayContain(uint32_t from, uint32_t to,
+		const string &username) const {
+	if ((from && toDate < from) || (to && fromDate > to)) {
+		return false;
 	}
+	return username.empty() || users.count(username) > 0;
 }
 
-void TransactionList::sortTransactions() {
-	//selection sort
-	std::shared_ptr<Node> node1 = head;
-	while (node1) {
-		//find the max element after i
-		std::shared_ptr<Node> maxIndex = node1;
-		std::shared_ptr<Node> node2 = node1;
-		while (node2) {
-			if (node2->data.getDateForCompare()
-					> maxIndex->data.getDateForCompare()) {
-				maxIndex = node2;
+//directory part of filename, with its trailing '/' ("" for none)
+static string directoryOf(const string &filename) {
+	size_t slash = filename.rfind('/');
+	return slash == string::npos ? "" : filename.substr(0, slash + 1);
+}
+
+//parse the manifest lines in the text of a transactions file
+static vector<SegmentInfo> parseManifest(const string &text,
+		const string &filename) {
+	vector<SegmentInfo> segments;
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t nl = text.find('\n', pos);
+		if (nl == string::npos) {
+			nl = text.size();
+		}
+		std::string_view line(text.data() + pos, nl - pos);
+		pos = nl + 1;
+		if (!hasTag(line, SEGMENT_TAG)) {
+			//the manifest comes first
+			if (hasTag(line, CHECKSUM_TAG)) {
+				break;
 			}
-			node2 = node2->next;
+			continue;
 		}
 
-		//swap maxIndex and node1
-		Transaction temp = node1->data;
-		node1->data = maxIndex->data;
-		maxIndex->data = temp;
-
-		node1 = node1->next;
+		istringstream iss(string(line.substr(SEGMENT_TAG.size())));
+		SegmentInfo segment;
+		string user;
+		iss >> segment.file >> segment.fromDate >> segment.toDate
+				>> segment.rows;
+		segment.file = directoryOf(filename) + segment.file;
+		while (iss >> user) {
+			//"<user>:<rows>/<mac>"; older manifests have no mac
+			size_t colon = user.rfind(':');
+			if (colon == string::npos) {
+				continue;
+			}
+			string name = user.substr(0, colon);
+			segment.users[name] = atoll(user.c_str() + colon + 1);
+			size_t slash = user.find('/', colon);
+			if (slash != string::npos) {
+				segment.digests[name] = user.substr(slash + 1);
+			}
+		}
+		segments.push_back(std::move(segment));
 	}
+	return segments;
 }
 
-UserList::UserList() {
-
+vector<SegmentInfo> readManifest(const string &filename) {
+	try {
+		return parseManifest(readPlainFile(filename, false), filename);
+	} catch (const FileException &e) {
+		//nothing saved yet
+		return vector<SegmentInfo>();
+	}
 }
 
-bool UserList::hasUser(const string &username) const {
-	std::shared_ptr<Node> node = head;
-	while (node) {
-		if (node->data.getUsername() == username) {
-			return true;
+//append the row lines of text to out, leaving out manifest and checksum lines
+static void appendRowLines(string &out, const string &text) {
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t nl = text.find('\n', pos);
+		if (nl == string::npos) {
+			nl = text.size();
 		}
-		node = node->next;
+		std::string_view line(text.data() + pos, nl - pos);
+		if (!hasTag(line, CHECKSUM_TAG) && !hasTag(line, SEGMENT_TAG)) {
+			out.append(line);
+			out += '\n';
+		}
+		pos = nl + 1;
 	}
-	return false;
 }
 
-bool UserList::login(const string &username, const string &password,
-		bool &admin) const {
-	admin = false;
-	string passwordEncrypted = User::hash(password);
+string readTransactionFile(const string &filename) {
+	string head = readPlainFile(filename, true);
+	vector<SegmentInfo> segments = parseManifest(head, filename);
+	if (segments.empty()) {
+		return head;
+	}
 
-	std::shared_ptr<Node> node = head;
-	while (node) {
-		if (node->data.getUsername() == username
-				&& node->data.getPassword() == passwordEncrypted) {
-			admin = node->data.isAdmin();
-			return true;
+	//read the next segment while this one is decrypted and checked
+	string text;
+	std::unique_ptr<FileRead> next(new FileRead(segments[0].file));
+	for (size_t i = 0; i < segments.size(); i++) {
+		std::unique_ptr<FileRead> current = std::move(next);
+		if (i + 1 < segments.size()) {
+			next.reset(new FileRead(segments[i + 1].file));
 		}
-		node = node->next;
+		if (!current->opened()) {
+			throw FileException(
+					"Failed to open file " + segments[i].file + ".");
+		}
+		appendRowLines(text,
+				openPlainImage(current->finish(), segments[i].file, true));
 	}
-	return false;
+	appendRowLines(text, head);
+	return text;
 }
 
-void UserList::loadFile(const string &filename) {
-	ifstream ifs(filename, ios::binary);
-	if (!ifs) {
-		throw FileException("No users found.");
+//read only the username and date of a row; return false if line is not a row
+static bool readRowKey(std::string_view line, string &username,
+		Transaction &dateHolder) {
+	//a row has 5 commas and a non-empty amount
+	size_t commas[5];
+	size_t pos = 0;
+	for (size_t &c : commas) {
+		c = line.find(',', pos);
+		if (c == std::string_view::npos) {
+			return false;
+		}
+		pos = c + 1;
 	}
-
-	while (ifs.peek() != EOF) {
-		User u;
-		u.readFromFile(ifs);
-		addToTail(u);
+	if (pos >= line.size()) {
+		return false;
 	}
-	ifs.close();
+
+	username.assign(line.data(), commas[0]);
+	dateHolder.setDate(
+			string(line.substr(commas[1] + 1, commas[2] - commas[1] - 1)));
+	return true;
 }
 
-void UserList::saveFile(const string &filename) {
-	ofstream ofs(filename, ios::binary);
-	if (!ofs) {
-		throw FileException("Failed to open file for writing.");
-		return;
+//hex digits of data
+static string toHex(const unsigned char *data, size_t size) {
+	static const char digits[] = "0123456789abcdef";
+	string out;
+	out.reserve(size * 2);
+	for (size_t i = 0; i < size; i++) {
+		out += digits[data[i] >> 4];
+		out += digits[data[i] & 0xf];
 	}
+	return out;
+}
 
-	std::shared_ptr<Node> node = head;
-	while (head) {
-		head->data.writeToFile(ofs);
-		head = head->next;
+//an HMAC-SHA256 key for one use (label), derived from the ledger key so
+//the sealing key is never used for anything else
+static string deriveKey(const char *label) {
+	unsigned char derived[SHA256_DIGEST_LENGTH];
+	if (HMAC(EVP_sha256(), ledgerKey(), SEALED_KEY_SIZE,
+			(const unsigned char*) label, strlen(label), derived, nullptr)
+			== nullptr) {
+		throw FileException("Failed to derive a key.");
 	}
-	ofs.close();
+	return string((const char*) derived, sizeof(derived));
 }
 
-App::App() {
+//the key of segment names and digests. without it a name or digest cannot
+//be checked against guessed rows.
+static const unsigned char* segmentKey() {
+	static const string key = deriveKey("A3TX segment names");
+	return (const unsigned char*) key.data();
+}
 
+//start an HMAC-SHA256 under the segment key in ctx
+static void segmentMacInit(EVP_MD_CTX *ctx) {
+	EVP_PKEY *key = EVP_PKEY_new_raw_private_key(EVP_PKEY_HMAC, nullptr,
+			segmentKey(), SHA256_DIGEST_LENGTH);
+	//ctx keeps its own reference to key
+	bool ok = key != nullptr
+			&& EVP_DigestSignInit(ctx, nullptr, EVP_sha256(), nullptr, key)
+					== 1;
+	EVP_PKEY_free(key);
+	if (!ok) {
+		throw FileException("Failed to hash transactions.");
+	}
 }
 
-//sign in
-void App::signIn() {
-	string temp;
-	string username, password;
+//hex HMAC-SHA256 of text under the segment key
+static string segmentMacHex(std::string_view text) {
+	unsigned char mac[SHA256_DIGEST_LENGTH];
+	if (HMAC(EVP_sha256(), segmentKey(), SHA256_DIGEST_LENGTH,
+			(const unsigned char*) text.data(), text.size(), mac, nullptr)
+			== nullptr) {
+		throw FileException("Failed to hash transactions.");
+	}
+	return toHex(mac, sizeof(mac));
+}
 
-	cout << "Enter username: ";
-	cin >> username;
-	cout << "Enter password: ";
-	cin >> password;
-	getline(cin, temp); //skip '\n'
+//the rows of one year, collected for a segment file
+struct SegmentBuilder {
+	string text;
+	SegmentInfo info;
+	//running HMAC of each user's lines
+	map<string, std::shared_ptr<EVP_MD_CTX>> hashes;
 
-	bool admin;
-	if (userList.login(username, password, admin)) {
-		currentUser = username;
-		transList.setCurrentUser(currentUser);
-		if (admin) {
-			runAdminMenu();
-		} else {
-			runUserMenu();
+	void add(std::string_view line, const string &username, uint32_t date);
+
+	//end the text with its checksum line, finish the user hashes and name
+	//the file after the content
+	void finish(const string &filename, uint32_t year);
+};
+
+void SegmentBuilder::add(std::string_view line, const string &username,
+		uint32_t date) {
+	text.append(line);
+	text += '\n';
+	if (info.rows == 0 || date < info.fromDate) {
+		info.fromDate = date;
+	}
+	info.toDate = std::max(info.toDate, date);
+	info.rows++;
+	info.users[username]++;
+
+	std::shared_ptr<EVP_MD_CTX> &hash = hashes[username];
+	if (!hash) {
+		hash.reset(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+		if (!hash) {
+			throw FileException("Failed to hash transactions.");
 		}
-	} else {
-		cout << "Sign in failed." << endl;
+		segmentMacInit(hash.get());
 	}
+	EVP_DigestSignUpdate(hash.get(), line.data(), line.size());
+	EVP_DigestSignUpdate(hash.get(), "\n", 1);
 }
 
-//sign up
-void App::signUp() {
-	string temp;
-	string username, password;
-	bool admin;
+void SegmentBuilder::finish(const string &filename, uint32_t year) {
+	text += checksumLine(text);
+	for (auto &hash : hashes) {
+		unsigned char digest[SHA256_DIGEST_LENGTH];
+		size_t size = sizeof(digest);
+		EVP_DigestSignFinal(hash.second.get(), digest, &size);
+		info.digests[hash.first] = toHex(digest, size);
+	}
+	hashes.clear();
 
-	cout << "Enter username: ";
-	cin >> username;
-	cout << "Enter password: ";
-	cin >> password;
-	cout << "Admin?(y/n): ";
-	cin >> temp;
-	std::transform(temp.begin(), temp.end(), temp.begin(), ::tolower); //convert temp to lowercase
-	admin = temp == "y";
-	getline(cin, temp); //skip '\n'
+	ostringstream name;
+	name << filename << '.' << year << '.' << segmentMacHex(text);
+	info.file = name.str();
+}
 
-	if (!userList.hasUser(username)) {
-		User u(username, password, admin);
-		userList.addToTail(u);
-	} else {
-		cout << "The username already exists." << endl;
+//add the rows of text to the segment of their year, leaving out the rows of
+//skipUser (if not empty) and any manifest or checksum lines
+static void addRows(map<uint32_t, SegmentBuilder> &years, const string &text,
+		const string &skipUser) {
+	Transaction dateHolder;
+	string username;
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t nl = text.find('\n', pos);
+		if (nl == string::npos) {
+			nl = text.size();
+		}
+		std::string_view line(text.data() + pos, nl - pos);
+		pos = nl + 1;
+		if (!readRowKey(line, username, dateHolder)
+				|| (!skipUser.empty() && username == skipUser)) {
+			continue;
+		}
+		uint32_t date = dateHolder.getDateKey();
+		years[date / 10000].add(line, username, date);
 	}
 }
 
-void App::runMenu() {
+//whether the segment file at path holds exactly text; a file that is
+//missing or fails its checks does not
+static bool segmentHolds(const string &path, const string &text) {
+	string image;
+	if (!readFileImage(path, image)) {
+		return false;
+	}
 	try {
-		userList.loadFile(USER_FILENAME);
-	} catch (const exception &e) {
-		cout << "Exception: " << e.what() << endl;
+		return openPlainImage(std::move(image), path, true) == text;
+	} catch (const FileException &e) {
+		return false;
 	}
+}
 
-	//Repeatedly show the menu until the user exits
-	bool quit = false;
-	while (!quit) {
-		//show the menu
-		cout << endl;
-		cout << "1. Sign in" << endl;
-		cout << "2. Sing up" << endl;
-		cout << "0. exit" << endl;
+//write the segments in built that are not on disk yet, then swap in a
+//manifest listing them and kept, and remove the segments of old it no
+//longer lists
+static void publishSegments(const string &filename,
+		map<uint32_t, SegmentBuilder> &built, map<uint32_t, SegmentInfo> &kept,
+		const vector<SegmentInfo> &old) {
+	//a name match alone is not trusted: the existing file is read back and
+	//compared before it is reused. each write runs while the next segment
+	//is sealed.
+	std::deque<string> sealed;
+	std::deque<FileReplace> writes;
+	for (auto &year : built) {
+		SegmentBuilder &segment = year.second;
+		if (segment.info.rows == 0) {
+			continue;
+		}
+		segment.finish(filename, year.first);
+		if (!segmentHolds(segment.info.file, segment.text)) {
+			sealed.push_back(sealText(segment.text));
+			writes.emplace_back(segment.info.file, sealed.back());
+		}
+		kept[year.first] = segment.info;
+	}
 
-		//Accept user input
-		string option;
-		getline(cin, option);
+	string manifest;
+	unordered_set<string> current;
+	for (const auto &year : kept) {
+		const SegmentInfo &info = year.second;
+		current.insert(info.file);
+
+		ostringstream entry;
+		entry << SEGMENT_TAG << ' ' << info.file.substr(
+				directoryOf(info.file).size()) << ' ' << info.fromDate << ' '
+				<< info.toDate << ' ' << info.rows;
+		for (const auto &user : info.users) {
+			entry << ' ' << user.first << ':' << user.second;
+			auto digest = info.digests.find(user.first);
+			if (digest != info.digests.end()) {
+				entry << '/' << digest->second;
+			}
+		}
+		manifest += entry.str();
+		manifest += '\n';
+	}
 
-		//Implement command handling via functions
-		if (option == "1") {
-			signIn();
-		} else if (option == "2") {
-			signUp();
-		} else if (option == "0") {
-			//user exits
-			quit = true;
+	//the manifest swap publishes the new segments and drops appended rows;
+	//its directory sync covers the segment renames too
+	for (FileReplace &write : writes) {
+		write.commit(false);
+	}
+	manifest += checksumLine(manifest);
+	replaceFile(filename, sealText(manifest));
+
+	for (const SegmentInfo &segment : old) {
+		if (current.count(segment.file) == 0) {
+			unlink(segment.file.c_str());
+		}
+	}
+}
+
+void writeTransactionFile(const string &filename, const string &text) {
+	map<uint32_t, SegmentBuilder> years;
+	addRows(years, text, "");
+	map<uint32_t, SegmentInfo> kept;
+	publishSegments(filename, years, kept, readManifest(filename));
+}
+
+void writeUserRows(const string &filename, const string &owner,
+		const string &text) {
+	//a missing file has nothing to keep; a file that cannot be read throws
+	//instead, so the save cannot drop the rows in it
+	string head;
+	struct stat st;
+	if (stat(filename.c_str(), &st) == 0 || errno != ENOENT) {
+		head = readPlainFile(filename, true);
+	}
+	vector<SegmentInfo> segments = parseManifest(head, filename);
+
+	map<uint32_t, SegmentBuilder> mine;
+	addRows(mine, text, "");
+
+	//a segment is kept untouched if owner's rows in it hash the same as
+	//owner's rows of that year now, and no rows of its year were appended
+	//since; only the others are read and rebuilt
+	map<uint32_t, SegmentBuilder> years;
+	map<uint32_t, SegmentInfo> kept;
+	map<uint32_t, SegmentBuilder> appended;
+	addRows(appended, head, owner);
+	for (const SegmentInfo &segment : segments) {
+		uint32_t year = segment.fromDate / 10000;
+		auto own = mine.find(year);
+		auto digest = segment.digests.find(owner);
+		bool same = own == mine.end() ?
+				segment.users.count(owner) == 0 :
+				digest != segment.digests.end()
+						&& digest->second == segmentMacHex(own->second.text);
+		if (same && appended.count(year) == 0) {
+			kept[year] = segment;
+			if (own != mine.end()) {
+				mine.erase(own);
+			}
+			continue;
+		}
+
+		if (own != mine.end()) {
+			years[year] = std::move(own->second);
+			mine.erase(own);
+		}
+		addRows(years, readPlainFile(segment.file, true), owner);
+	}
+
+	//years owner had no segment for yet, then the rows other sessions
+	//appended since the last full save
+	for (auto &year : mine) {
+		years[year.first] = std::move(year.second);
+	}
+	addRows(years, head, owner);
+
+	publishSegments(filename, years, kept, segments);
+}
+
+//append value to out as raw bytes
+template<class T>
+static void appendRaw(string &out, const T &value) {
+	out.append((const char*) &value, sizeof(value));
+}
+
+//pad out with zeros to a multiple of 8 bytes
+static void padTo8(string &out) {
+	out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+//the key of snapshot headers
+static const unsigned char* snapshotKey() {
+	static const string key = deriveKey("A3SN snapshot header");
+	return (const unsigned char*) key.data();
+}
+
+//HMAC-SHA256 of a snapshot header (without its mac) under the snapshot key
+static string snapshotMac(std::string_view header) {
+	unsigned char mac[SHA256_DIGEST_LENGTH];
+	if (HMAC(EVP_sha256(), snapshotKey(), SHA256_DIGEST_LENGTH,
+			(const unsigned char*) header.data(), header.size(), mac, nullptr)
+			== nullptr) {
+		throw FileException("Failed to hash the snapshot.");
+	}
+	return string((const char*) mac, sizeof(mac));
+}
+
+void writeSnapshot(const string &filename, const string &text) {
+	TransactionColumns cols;
+	bool exact = true;
+	cols.reserve(text.size() / 40); //a typical row is 40 to 50 bytes
+	size_t pos = 0;
+	while (pos < text.size() && exact) {
+		size_t nl = text.find('\n', pos);
+		if (nl == string::npos) {
+			nl = text.size();
 		}
+		cols.appendLine(std::string_view(text).substr(pos, nl - pos), exact);
+		pos = nl + 1;
+	}
+	string snapName = filename + SNAPSHOT_SUFFIX;
+	if (!exact) {
+		//rows the image cannot hold as they are: the text has to be read
+		unlink(snapName.c_str());
+		return;
+	}
+
+	//stale once the manifest or any of its segments changes
+	vector<string> sources(1, filename);
+	for (const SegmentInfo &segment : readManifest(filename)) {
+		sources.push_back(segment.file);
+	}
+	string header(SNAPSHOT_HEADER_SIZE, '\0');
+	for (const string &source : sources) {
+		FileStamp stamp = FileStamp::of(source);
+		appendRaw(header, (int64_t) stamp.device);
+		appendRaw(header, (int64_t) stamp.inode);
+		appendRaw(header, (int64_t) stamp.size);
+		appendRaw(header, (int64_t) stamp.mtimeSec);
+		appendRaw(header, (int64_t) stamp.mtimeNsec);
+		appendRaw(header, (uint32_t) source.size());
+		header += source;
+		padTo8(header);
 	}
 
+	//no fsync: a snapshot cut short by a crash fails its checks and is
+	//rebuilt
 	try {
-		userList.saveFile(USER_FILENAME);
-	} catch (const exception &e) {
-		cout << "Exception: " << e.what() << endl;
+		unsigned char id[SNAPSHOT_ID_SIZE];
+		if (RAND_bytes(id, sizeof(id)) != 1) {
+			return;
+		}
+		uint32_t sourceCount = sources.size();
+		uint32_t headerSize = header.size() + SHA256_DIGEST_LENGTH;
+		memcpy(&header[0], SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		memcpy(&header[4], &SNAPSHOT_VERSION, sizeof(SNAPSHOT_VERSION));
+		memcpy(&header[8], &sourceCount, sizeof(sourceCount));
+		memcpy(&header[12], &headerSize, sizeof(headerSize));
+		memcpy(&header[16], id, sizeof(id));
+		header += snapshotMac(header);
+
+		string body((const char*) id, sizeof(id));
+		cols.writeImage(body);
+		string image = header + sealText(body);
+
+		FileLock lock(snapName, true);
+		string tmpName = snapName + ".tmp";
+		int fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			return;
+		}
+		bool ok = writeFully(fd, image);
+		close(fd);
+		if (!ok || rename(tmpName.c_str(), snapName.c_str()) != 0) {
+			unlink(tmpName.c_str());
+		}
+	} catch (const FileException &e) {
+		//the next load just reads the text again
 	}
 }
 
-//show normal user menu.
-void App::runUserMenu() {
+void refreshSnapshot(const string &filename) {
 	try {
-		transList.loadFile(TRANS_FILENAME);
-	} catch (const exception &e) {
-		cout << "Exception: " << e.what() << endl;
+		FileLock lock(filename, false);
+		writeSnapshot(filename, readTransactionFile(filename));
+	} catch (const FileException &e) {
+		//the next load reads the text instead
 	}
+}
 
-	//Repeatedly show the menu until the user exits
-	bool quit = false;
-	while (!quit) {
-		//show the menu
-		cout << endl;
-		cout << "1. add transaction" << endl;
-		cout << "2. modify transaction" << endl;
-		cout << "3. search transactions" << endl;
-		cout << "4. sort transactions" << endl;
-		cout << "5. display transactions" << endl;
-		cout << "0. exit" << endl;
+//whether the sources listed in a snapshot header (after the fixed part,
+//before the mac) are all unchanged
+static bool snapshotSourcesCurrent(const string &header,
+		uint32_t sourceCount) {
+	const char *data = header.data();
+	size_t size = header.size() - SHA256_DIGEST_LENGTH;
+	size_t pos = SNAPSHOT_HEADER_SIZE;
+	for (uint32_t i = 0; i < sourceCount; i++) {
+		int64_t fields[5];
+		uint32_t nameLength;
+		if (size - pos < sizeof(fields) + sizeof(nameLength)) {
+			return false;
+		}
+		memcpy(fields, data + pos, sizeof(fields));
+		memcpy(&nameLength, data + pos + sizeof(fields), sizeof(nameLength));
+		pos += sizeof(fields) + sizeof(nameLength);
+		if (size - pos < nameLength) {
+			return false;
+		}
+		FileStamp stamp = FileStamp::of(string(data + pos, nameLength));
+		if (!(stamp.device == (dev_t) fields[0]
+				&& stamp.inode == (ino_t) fields[1]
+				&& stamp.size == (off_t) fields[2]
+				&& stamp.mtimeSec == fields[3]
+				&& stamp.mtimeNsec == fields[4])) {
+			return false;
+		}
+		pos = std::min(size, (pos + nameLength + 7) / 8 * 8);
+	}
+	return true;
+}
 
-		//Accept user input
-		string option;
-		getline(cin, option);
+//read the header of the snapshot open at fd into header and, if it is
+//authentic and every source in it is unchanged, the sealed body after it
+//into image. only the header is read for a stale snapshot.
+static bool readCurrentSnapshot(int fd, string &header, string &image) {
+	struct stat st;
+	header.assign(SNAPSHOT_HEADER_SIZE, '\0');
+	if (fstat(fd, &st) != 0
+			|| readFully(fd, &header[0], header.size()) != header.size()) {
+		return false;
+	}
+	uint32_t version, sourceCount, headerSize;
+	memcpy(&version, &header[4], sizeof(version));
+	memcpy(&sourceCount, &header[8], sizeof(sourceCount));
+	memcpy(&headerSize, &header[12], sizeof(headerSize));
+	if (memcmp(header.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+			|| version != SNAPSHOT_VERSION
+			|| headerSize < SNAPSHOT_HEADER_SIZE + SHA256_DIGEST_LENGTH
+			|| headerSize > st.st_size) {
+		return false;
+	}
 
-		//Implement command handling via functions
-		if (option == "1") {
-			addTransaction();
-		} else if (option == "2") {
-			modifyTransaction();
-		} else if (option == "3") {
-			searchTransaction();
-		} else if (option == "4") {
-			sortTransactions();
-		} else if (option == "5") {
-			displayTransactions();
-		} else if (option == "0") {
-			//user exits
-			quit = true;
+	header.resize(headerSize);
+	size_t rest = headerSize - SNAPSHOT_HEADER_SIZE;
+	if (readFully(fd, &header[SNAPSHOT_HEADER_SIZE], rest) != rest) {
+		return false;
+	}
+	std::string_view signedPart(header.data(),
+			headerSize - SHA256_DIGEST_LENGTH);
+	if (CRYPTO_memcmp(snapshotMac(signedPart).data(),
+			header.data() + signedPart.size(), SHA256_DIGEST_LENGTH) != 0
+			|| !snapshotSourcesCurrent(header, sourceCount)) {
+		return false;
+	}
+
+	image.resize(st.st_size - headerSize);
+	return readFully(fd, &image[0], image.size()) == image.size();
+}
+
+bool readSnapshot(const string &filename, TransactionColumns &cols) {
+	string snapName = filename + SNAPSHOT_SUFFIX;
+	int fd = open(snapName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	string header, image;
+	bool ok;
+	try {
+		ok = readCurrentSnapshot(fd, header, image);
+	} catch (const FileException &e) {
+		ok = false;
+	}
+	close(fd);
+	if (!ok) {
+		return false;
+	}
+
+	try {
+		bool sealed;
+		image = openSealed(std::move(image), snapName, sealed);
+		if (!sealed) {
+			return false;
+		}
+	} catch (const FileException &e) {
+		return false;
+	}
+
+	//the body must be the one this header was written with
+	return image.size() >= SNAPSHOT_ID_SIZE
+			&& memcmp(image.data(), &header[16], SNAPSHOT_ID_SIZE) == 0
+			&& cols.readImage(image.data() + SNAPSHOT_ID_SIZE,
+					image.size() - SNAPSHOT_ID_SIZE);
+}
+
+void replaceFile(const string &filename, const string &data) {
+	FileReplace(filename, data).commit();
+}
+
+IoRequest::IoRequest(int fd, char *data, size_t size, off_t offset,
+		bool write) :
+		fd(fd), data(data), size(size), offset(offset), write(write), transferred(
+				0), error(0), done(false) {
+}
+
+IoBackend& IoBackend::forThread() {
+	//a ring is not shared between threads, so each thread gets its own
+	static thread_local std::unique_ptr<IoBackend> backend;
+	if (!backend) {
+		try {
+			backend.reset(new UringBackend());
+		} catch (const FileException &e) {
+			backend.reset(new PreadBackend());
+		}
+	}
+	return *backend;
+}
+
+UringBackend::UringBackend() :
+		sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes(
+				(io_uring_sqe*) MAP_FAILED), inFlight(0) {
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ringFd = syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params);
+	if (ringFd < 0) {
+		throw FileException("io_uring is not available.");
+	}
+
+	//IORING_OP_READ and IORING_OP_WRITE came in Linux 5.6; older rings
+	//fail them with EINVAL, and have no probe either
+	vector<uint64_t> probeData(
+			(sizeof(io_uring_probe)
+					+ IORING_OP_LAST * sizeof(io_uring_probe_op) + 7) / 8);
+	io_uring_probe *probe = (io_uring_probe*) probeData.data();
+	auto supported = [probe](unsigned op) {
+		return op <= probe->last_op
+				&& (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	};
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe,
+			IORING_OP_LAST) < 0 || !supported(IORING_OP_READ)
+			|| !supported(IORING_OP_WRITE)) {
+		close(ringFd);
+		throw FileException("io_uring cannot read or write files.");
+	}
+	entries = params.sq_entries;
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes
+			+ params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	}
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (sqRing != MAP_FAILED) {
+		cqRing = params.features & IORING_FEAT_SINGLE_MMAP ?
+				sqRing :
+				mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		sqes = (io_uring_sqe*) mmap(nullptr, sqesSize,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+				IORING_OFF_SQES);
+	}
+	if (sqRing == MAP_FAILED || cqRing == MAP_FAILED
+			|| sqes == (io_uring_sqe*) MAP_FAILED) {
+		unmap();
+		throw FileException("io_uring is not available.");
+	}
+
+	char *sq = (char*) sqRing;
+	char *cq = (char*) cqRing;
+	sqTail = (unsigned*) (sq + params.sq_off.tail);
+	sqMask = *(unsigned*) (sq + params.sq_off.ring_mask);
+	sqArray = (unsigned*) (sq + params.sq_off.array);
+	cqHead = (unsigned*) (cq + params.cq_off.head);
+	cqTail = (unsigned*) (cq + params.cq_off.tail);
+	cqMask = *(unsigned*) (cq + params.cq_off.ring_mask);
+	cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+}
+
+UringBackend::~UringBackend() {
+	unmap();
+}
+
+void UringBackend::unmap() {
+	if (sqes != (io_uring_sqe*) MAP_FAILED) {
+		munmap(sqes, sqesSize);
+	}
+	if (cqRing != MAP_FAILED && cqRing != sqRing) {
+		munmap(cqRing, cqRingSize);
+	}
+	if (sqRing != MAP_FAILED) {
+		munmap(sqRing, sqRingSize);
+	}
+	close(ringFd);
+}
+
+const char* UringBackend::name() const {
+	return "io_uring";
+}
+
+void UringBackend::push(IoRequest &req) {
+	//keep no more requests in flight than the completion queue can hold
+	while (inFlight >= entries) {
+		syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS,
+				nullptr, 0);
+		reap();
+	}
+
+	unsigned tail = *sqTail;
+	unsigned index = tail & sqMask;
+	io_uring_sqe &sqe = sqes[index];
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = req.write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe.fd = req.fd;
+	sqe.addr = (uint64_t) (req.data + req.transferred);
+	sqe.len = req.size - req.transferred;
+	sqe.off = req.offset + req.transferred;
+	sqe.user_data = (uint64_t) &req;
+	sqArray[index] = index;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	int submitted;
+	do {
+		submitted = syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0);
+	} while (submitted < 0 && (errno == EINTR || errno == EAGAIN));
+	if (submitted != 1) {
+		throw FileException("Failed to submit file I/O.");
+	}
+	inFlight++;
+}
+
+void UringBackend::reap() {
+	unsigned head = *cqHead;
+	unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+	vector<IoRequest*> again;
+	for (; head != tail; head++) {
+		io_uring_cqe &cqe = cqes[head & cqMask];
+		IoRequest &req = *(IoRequest*) cqe.user_data;
+		inFlight--;
+		if (cqe.res < 0) {
+			req.error = -cqe.res;
+			req.done = true;
+		} else {
+			req.transferred += cqe.res;
+			req.done = cqe.res == 0 || req.transferred == req.size;
+			if (cqe.res == 0 && req.write) {
+				req.error = EIO;
+			}
+			if (!req.done) {
+				again.push_back(&req);
+			}
+		}
+	}
+	__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+	//continue short transfers once the queue slots are given back
+	for (IoRequest *req : again) {
+		push(*req);
+	}
+}
+
+void UringBackend::submit(IoRequest &req) {
+	req.transferred = 0;
+	req.error = 0;
+	req.done = req.size == 0;
+	if (!req.done) {
+		push(req);
+	}
+}
+
+void UringBackend::wait(IoRequest &req) {
+	reap();
+	while (!req.done) {
+		int ret = syscall(__NR_io_uring_enter, ringFd, 0, 1,
+				IORING_ENTER_GETEVENTS, nullptr, 0);
+		if (ret < 0 && errno != EINTR) {
+			throw FileException("Failed to wait for file I/O.");
+		}
+		reap();
+	}
+}
+
+const char* PreadBackend::name() const {
+	return "pread";
+}
+
+void PreadBackend::submit(IoRequest &req) {
+	req.transferred = 0;
+	req.error = 0;
+	while (req.transferred < req.size) {
+		ssize_t n =
+				req.write ?
+						pwrite(req.fd, req.data + req.transferred,
+								req.size - req.transferred,
+								req.offset + req.transferred) :
+						pread(req.fd, req.data + req.transferred,
+								req.size - req.transferred,
+								req.offset + req.transferred);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			req.error = n < 0 ? errno : req.write ? EIO : 0;
+			break;
+		}
+		req.transferred += n;
+	}
+	req.done = true;
+}
+
+void PreadBackend::wait(IoRequest&) {
+}
+
+FileRead::FileRead(const string &filename, IoBackend &io) :
+		io(io), filename(filename), submitted(0) {
+	fd = open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		return;
+	}
+
+	image.resize(st.st_size);
+	blocks.reserve((image.size() + IO_BLOCK_SIZE - 1) / IO_BLOCK_SIZE);
+	for (size_t pos = 0; pos < image.size(); pos += IO_BLOCK_SIZE) {
+		blocks.emplace_back(fd, &image[pos],
+				std::min(IO_BLOCK_SIZE, image.size() - pos), pos, false);
+	}
+	while (submitted < blocks.size() && submitted < IO_QUEUE_DEPTH) {
+		io.submit(blocks[submitted++]);
+	}
+}
+
+FileRead::~FileRead() {
+	//the kernel may still be writing into image
+	try {
+		for (size_t i = 0; i < submitted; i++) {
+			io.wait(blocks[i]);
+		}
+	} catch (const FileException &e) {
+		//destructors must not throw
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+bool FileRead::opened() const {
+	return fd >= 0;
+}
+
+string FileRead::finish() {
+	bool failed = fd < 0;
+	size_t size = 0;
+	for (size_t i = 0; i < blocks.size(); i++) {
+		io.wait(blocks[i]);
+		if (submitted < blocks.size()) {
+			io.submit(blocks[submitted++]);
+		}
+		failed = failed || blocks[i].error != 0;
+		if (size == i * IO_BLOCK_SIZE) {
+			//a file that shrank since the fstat ends at its first short block
+			size += blocks[i].transferred;
+		}
+	}
+	if (failed) {
+		throw FileException("Failed to read " + filename + ".");
+	}
+	image.resize(size);
+	return std::move(image);
+}
+
+bool readFileImage(const string &filename, string &image) {
+	FileRead read(filename);
+	if (!read.opened()) {
+		return false;
+	}
+	image = read.finish();
+	return true;
+}
+
+FileReplace::FileReplace(const string &filename, std::string_view data,
+		IoBackend &io, mode_t mode) :
+		io(io), filename(filename), tmpName(filename + ".tmp"), submitted(0) {
+	fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (fd < 0) {
+		throw FileException("Failed to create file " + tmpName + ".");
+	}
+
+	blocks.reserve((data.size() + IO_BLOCK_SIZE - 1) / IO_BLOCK_SIZE);
+	for (size_t pos = 0; pos < data.size(); pos += IO_BLOCK_SIZE) {
+		blocks.emplace_back(fd, (char*) data.data() + pos,
+				std::min(IO_BLOCK_SIZE, data.size() - pos), pos, true);
+	}
+	while (submitted < blocks.size() && submitted < IO_QUEUE_DEPTH) {
+		io.submit(blocks[submitted++]);
+	}
+}
+
+FileReplace::~FileReplace() {
+	if (fd < 0) {
+		return;
+	}
+	try {
+		for (size_t i = 0; i < submitted; i++) {
+			io.wait(blocks[i]);
+		}
+	} catch (const FileException &e) {
+		//destructors must not throw
+	}
+	close(fd);
+	unlink(tmpName.c_str());
+}
+
+void FileReplace::waitAll() {
+	bool failed = false;
+	for (size_t i = 0; i < blocks.size(); i++) {
+		io.wait(blocks[i]);
+		if (submitted < blocks.size()) {
+			io.submit(blocks[submitted++]);
 		}
+		failed = failed || blocks[i].error != 0;
+	}
+	if (failed || fsync(fd) != 0) {
+		throw FileException("Failed to write file " + tmpName + ".");
+	}
+}
+
+void FileReplace::commit(bool syncDirectory) {
+	waitAll();
+	close(fd);
+	fd = -1;
+
+	if (rename(tmpName.c_str(), filename.c_str()) != 0) {
+		unlink(tmpName.c_str());
+		throw FileException("Failed to replace file " + filename + ".");
+	}
+	if (!syncDirectory) {
+		return;
+	}
+
+	//sync the directory so the rename itself survives a crash
+	size_t slash = filename.rfind('/');
+	string dir = slash == string::npos ? "." :
+			slash == 0 ? "/" : filename.substr(0, slash);
+	int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if (dirFd >= 0) {
+		fsync(dirFd);
+		close(dirFd);
+	}
+}
+
+TransactionType Transaction::getTypeInt() const {
+	return type;
+}
+TransactionCategory Transaction::getCategoryInt() const {
+	return category;
+}
+
+FileLock::FileLock(const string &filename, bool exclusive) {
+	string lockName = filename + ".lock";
+	fd = open(lockName.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		throw FileException("Failed to open lock file " + lockName + ".");
+	}
+	if (flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+		close(fd);
+		throw FileException("Failed to lock " + filename + ".");
+	}
+}
+
+FileLock::~FileLock() {
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+FileStamp::FileStamp() :
+		device(0), inode(0), size(0), mtimeSec(0), mtimeNsec(0) {
+}
+
+FileStamp FileStamp::of(const string &filename) {
+	FileStamp stamp;
+	struct stat st;
+	if (stat(filename.c_str(), &st) == 0) {
+		stamp.device = st.st_dev;
+		stamp.inode = st.st_ino;
+		stamp.size = st.st_size;
+		stamp.mtimeSec = st.st_mtim.tv_sec;
+		stamp.mtimeNsec = st.st_mtim.tv_nsec;
+	}
+	return stamp;
+}
+
+bool FileStamp::operator==(const FileStamp &other) const {
+	return device == other.device && inode == other.inode
+			&& size == other.size && mtimeSec == other.mtimeSec
+			&& mtimeNsec == other.mtimeNsec;
+}
+
+SaveWorker::SaveWorker() :
+		changes(0), intervalMs(AUTOSAVE_INTERVAL_MS), dirtyThreshold(
+				AUTOSAVE_DIRTY_ROWS), writing(false), flushing(false), stopping(
+				false) {
+}
+
+SaveWorker::~SaveWorker() {
+	stop();
+}
+
+void SaveWorker::start(int intervalMs, int dirtyThreshold) {
+	if (worker.joinable()) {
+		return;
+	}
+	this->intervalMs = intervalMs;
+	this->dirtyThreshold = dirtyThreshold;
+	stopping = false;
+	worker = std::thread(&SaveWorker::run, this);
+}
+
+bool SaveWorker::running() const {
+	return worker.joinable();
+}
+
+void SaveWorker::submitAppend(const string &filename,
+		vector<Transaction> &&rows) {
+	enqueue(Job { filename, true, "", std::move(rows), nullptr });
+}
+
+void SaveWorker::submitRewrite(const string &filename, const string &owner,
+		std::function<void(string&)> format) {
+	enqueue(Job { filename, false, owner, vector<Transaction>(),
+			std::move(format) });
+}
+
+void SaveWorker::enqueue(Job &&job) {
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if (!job.append) {
+		//a full rewrite supersedes everything still waiting
+		jobs.clear();
+	}
+
+	if (job.append && !jobs.empty() && jobs.back().append
+			&& jobs.back().filename == job.filename) {
+		vector<Transaction> &queued = jobs.back().rows;
+		queued.insert(queued.end(), std::make_move_iterator(job.rows.begin()),
+				std::make_move_iterator(job.rows.end()));
+	} else {
+		jobs.push_back(std::move(job));
+	}
+
+	if (changes == 0) {
+		deadline = std::chrono::steady_clock::now()
+				+ std::chrono::milliseconds(intervalMs);
+	}
+	changes++;
+	wake.notify_one();
+}
+
+void SaveWorker::flush() {
+	std::unique_lock<std::mutex> lock(mtx);
+	if (!worker.joinable()) {
+		return;
+	}
+	flushing = true;
+	wake.notify_one();
+	idle.wait(lock, [this] {
+		return jobs.empty() && !writing;
+	});
+	flushing = false;
+}
+
+void SaveWorker::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!worker.joinable()) {
+			return;
+		}
+		stopping = true;
+	}
+	wake.notify_one();
+	worker.join();
+}
+
+string SaveWorker::takeError() {
+	std::lock_guard<std::mutex> lock(mtx);
+	string error;
+	error.swap(lastError);
+	return error;
+}
+
+void SaveWorker::run() {
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true) {
+		if (jobs.empty()) {
+			if (stopping) {
+				break;
+			}
+			wake.wait(lock);
+			continue;
+		}
+
+		//hold the write back until the interval passes or enough changes pile up
+		if (!stopping && !flushing && changes < dirtyThreshold
+				&& wake.wait_until(lock, deadline) == std::cv_status::no_timeout) {
+			continue;
+		}
+
+		deque<Job> batch;
+		batch.swap(jobs);
+		changes = 0;
+		writing = true;
+		lock.unlock();
+
+		string error;
+		vector<string> written;
+		for (const Job &job : batch) {
+			try {
+				writeRows(job);
+				if (std::find(written.begin(), written.end(), job.filename)
+						== written.end()) {
+					written.push_back(job.filename);
+				}
+			} catch (const FileException &e) {
+				error = e.what();
+			}
+		}
+
+		lock.lock();
+		writing = false;
+		if (!error.empty()) {
+			lastError = error;
+		}
+		idle.notify_all();
+
+		//the writes left the snapshots stale. rebuild them here, off the
+		//sessions' path, unless another write is already queued.
+		if (!written.empty() && jobs.empty()) {
+			lock.unlock();
+			for (const string &filename : written) {
+				refreshSnapshot(filename);
+			}
+			lock.lock();
+		}
+	}
+	idle.notify_all();
+}
+
+void SaveWorker::setStamp(const string &filename, const FileStamp &stamp) {
+	std::lock_guard<std::mutex> lock(mtx);
+	stamps[filename] = stamp;
+}
+
+bool SaveWorker::isCurrent(const string &filename) {
+	std::lock_guard<std::mutex> lock(mtx);
+	auto stamp = stamps.find(filename);
+	return stamp != stamps.end() && stamp->second == FileStamp::of(filename);
+}
+
+void SaveWorker::writeRows(const Job &job) {
+	//format before locking the file: format may wait for a thread that is
+	//itself waiting for the file lock
+	string buf;
+	if (job.append) {
+		for (const Transaction &trans : job.rows) {
+			buf += formatTransaction(trans);
+			buf += '\n';
+		}
+	} else {
+		job.format(buf);
+	}
+
+	FileLock lock(job.filename, true);
+
+	//if nobody else wrote the file since we last did, the sessions' cached
+	//rows stay current after this write too
+	bool current;
+	{
+		std::lock_guard<std::mutex> guard(mtx);
+		auto stamp = stamps.find(job.filename);
+		current = stamp != stamps.end()
+				&& stamp->second == FileStamp::of(job.filename);
+		stamps.erase(job.filename);
+	}
+
+	if (!job.append) {
+		if (job.owner.empty()) {
+			writeTransactionFile(job.filename, buf);
+		} else {
+			//keep rows other sessions saved for other users
+			writeUserRows(job.filename, job.owner, buf);
+		}
+		if (current) {
+			std::lock_guard<std::mutex> guard(mtx);
+			stamps[job.filename] = FileStamp::of(job.filename);
+		}
+		return;
+	}
+
+	//appends never touch the rows already in the file
+	appendTransactionText(job.filename, buf);
+}
+
+TransactionList::TransactionList() :
+		loaded(true), saver(nullptr), colsValid(false), descriptionsValid(true) {
+}
+
+TransactionList::~TransactionList() {
+	if (saver) {
+		saver->flush();
+	}
+}
+
+void TransactionList::setSaveWorker(SaveWorker *worker) {
+	saver = worker;
+}
+
+void TransactionList::changed() {
+	colsValid = false;
+	if (!saver || !saver->running() || sourceFile.empty()) {
+		return;
+	}
+
+	string error = saver->takeError();
+	if (!error.empty()) {
+		cout << "Exception: " << error << endl;
+	}
+
+	if (loaded) {
+		//only this user's partition is rewritten, unless no user is set.
+		//the worker formats the rows itself when it writes, so an edit
+		//copies nothing and a burst of edits is written once.
+		string owner = currentUser;
+		saver->submitRewrite(sourceFile, owner, [this, owner](string &out) {
+			formatRows(owner, out);
+		});
+	} else {
+		//the worker appends these; materialize() reads them back from the file
+		vector<Transaction> rows;
+		pending.moveTo(rows);
+		saver->submitAppend(sourceFile, std::move(rows));
+	}
+}
+
+void TransactionList::formatRows(const string &owner, string &out) const {
+	std::lock_guard<std::mutex> guard(rowsLock);
+	auto format = [&out](const Transaction &trans) {
+		out += formatTransaction(trans);
+		out += '\n';
+	};
+
+	//after a user switch, owner's rows are parked with the others
+	if (owner.empty()) {
+		forEach(format);
+		for (const auto &partition : others) {
+			partition.second.forEach(format);
+		}
+	} else if (owner == currentUser) {
+		forEach(format);
+	} else {
+		auto partition = others.find(owner);
+		if (partition != others.end()) {
+			partition->second.forEach(format);
+		}
+	}
+}
+
+void TransactionList::setCurrentUser(const string &username) {
+	if (username == currentUser) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> guard(rowsLock);
+	if (loaded && !sourceFile.empty()) {
+		//park the current rows with the others and take username's
+		others[currentUser].swap(*this);
+		swap(others[username]);
+		others.erase(username);
+		if (others[currentUser].empty()) {
+			others.erase(currentUser);
+		}
+		colsValid = false;
+		undoLog.clear();
+		redoLog.clear();
+	}
+	currentUser = username;
+	guard.unlock();
+	descriptions.clear();
+	descriptionsValid = false;
+	rebuildBudgets();
+}
+
+void TransactionList::rebuildBudgets() {
+	budgets.reset();
+	if (!budgets.active()) {
+		return;
+	}
+	std::shared_ptr<Node> node = head;
+	while (node) {
+		budgets.apply(node->data, 1);
+		node = node->next;
+	}
+	//alerts are for changes, not for rows that were already there
+	budgets.takeAlerts();
+}
+
+void TransactionList::setBudgetLimits(
+		const double limits[TRANSACTION_CATEGORY_COUNT]) {
+	budgets.setLimits(limits);
+	if (loaded) {
+		rebuildBudgets();
+	}
+}
+
+void TransactionList::setBudget(TransactionCategory category, double limit) {
+	//a budget needs the month totals, so the rows must be in memory
+	materialize();
+	budgets.setLimit(category, limit);
+	rebuildBudgets();
+}
+
+vector<string> TransactionList::takeAlerts() {
+	return budgets.takeAlerts();
+}
+
+void TransactionList::loadFile(const string &filename) {
+	//wait for any save in progress
+	FileLock lock(filename, false);
+
+	//a current snapshot holds the same rows, already parsed
+	TransactionColumns image;
+	if (readSnapshot(filename, image)) {
+		if (saver) {
+			saver->setStamp(filename, FileStamp::of(filename));
+		}
+		std::unique_lock<std::mutex> guard(rowsLock);
+		clear();
+		others.clear();
+		sourceFile = filename;
+
+		RowList *partition = nullptr;
+		std::string_view partitionUser;
+		descriptions.clear();
+		for (size_t i = 0; i < image.size(); i++) {
+			std::string_view username = image.username(i);
+			if (username == currentUser) {
+				Transaction row = image.row(i);
+				descriptions.add(row.getDescription());
+				addToTail(std::move(row));
+				continue;
+			}
+			if (!partition || username != partitionUser) {
+				partition = &others[string(username)];
+				partitionUser = username;
+			}
+			partition->addToTail(image.row(i));
+		}
+		guard.unlock();
+		loaded = true;
+		colsValid = false;
+		descriptionsValid = true;
+		rebuildBudgets();
+
+		cout << "loaded " << size() << " transactions from " << filename
+				<< " (snapshot)." << endl;
+		return;
+	}
+
+	//read and verify the whole file (throws if it does not exist)
+	string text = readTransactionFile(filename);
+	if (saver) {
+		saver->setStamp(filename, FileStamp::of(filename));
+	}
+
+	std::unique_lock<std::mutex> guard(rowsLock);
+	clear();
+	others.clear();
+	descriptions.clear();
+	sourceFile = filename;
+
+	string line;
+	Transaction trans;
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t nl = text.find('\n', pos);
+		if (nl == string::npos) {
+			nl = text.size();
+		}
+		line.assign(text, pos, nl - pos);
+		pos = nl + 1;
+
+		//parse this user's rows straight into a new node
+		if (isOwnedBy(line, currentUser)) {
+			Transaction &row = emplaceTail();
+			if (row.readLine(line)) {
+				descriptions.add(row.getDescription());
+			} else {
+				removeTail();
+			}
+		} else if (trans.readLine(line)) {
+			others[trans.getUsername()].addToTail(std::move(trans));
+		}
+	}
+	guard.unlock();
+	loaded = true;
+	colsValid = false;
+	descriptionsValid = true;
+	rebuildBudgets();
+
+	cout << "loaded " << size() << " transactions from " << filename << "."
+			<< endl;
+}
+
+void TransactionList::attachFile(const string &filename) {
+	undoLog.clear();
+	redoLog.clear();
+
+	//queued rewrites read the rows, so they go out before the rows do
+	if (saver) {
+		saver->flush();
+	}
+
+	//the rows in memory are still what the file holds: nothing to reload
+	if (loaded && saver && filename == sourceFile
+			&& saver->isCurrent(filename)) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(rowsLock);
+	clear();
+	others.clear();
+	pending.clear();
+	descriptions.clear();
+	descriptionsValid = true;
+	sourceFile = filename;
+	loaded = false;
+}
+
+void TransactionList::materialize() {
+	if (loaded) {
+		return;
+	}
+
+	//queued appends must reach the file before it is read
+	if (saver) {
+		saver->flush();
+	}
+
+	//a missing file simply means there are no transactions yet. any other
+	//failure throws and leaves the list unloaded, so no save can replace
+	//the rows in the file with an empty partition.
+	struct stat st;
+	if (stat(sourceFile.c_str(), &st) == 0 || errno != ENOENT) {
+		loadFile(sourceFile);
+	}
+	loaded = true;
+
+	//rows added before the load go after the rows from the file
+	vector<Transaction> rows;
+	pending.moveTo(rows);
+	std::lock_guard<std::mutex> guard(rowsLock);
+	for (Transaction &trans : rows) {
+		budgets.apply(trans, 1);
+		if (descriptionsValid) {
+			descriptions.add(trans.getDescription());
+		}
+		addToTail(std::move(trans));
+	}
+}
+
+void TransactionList::saveFile(const string &filename) {
+	if (saver && saver->running() && filename == sourceFile) {
+		//every change was already handed to the worker
+		saver->flush();
+		string error = saver->takeError();
+		if (!error.empty()) {
+			throw FileException(error);
+		}
+		cout << "saved " << (loaded ? size() : 0) << " transactions to "
+				<< filename << "." << endl;
+		return;
+	}
+
+	if (!loaded) {
+		//nothing was read, so only the new rows need to reach the file
+		if (pending.empty()) {
+			return;
+		}
+
+		FileLock lock(filename, true);
+		ostringstream oss;
+		pending.saveFile(oss);
+		appendTransactionText(filename, oss.str());
+
+		cout << "appended " << pending.size() << " transactions to "
+				<< filename << "." << endl;
+		pending.clear();
+		return;
+	}
+
+	//output all transactions, then write the changed segments; other
+	//sessions may have saved their users' rows since we loaded, so a
+	//session for one user merges its rows into the file
+	FileLock lock(filename, true);
+	ostringstream oss;
+	RowList::saveFile(oss);
+	if (currentUser.empty()) {
+		for (const auto &partition : others) {
+			partition.second.saveFile(oss);
+		}
+		writeTransactionFile(filename, oss.str());
+	} else {
+		writeUserRows(filename, currentUser, oss.str());
+	}
+
+	cout << "saved " << size() << " transactions to " << filename << "."
+			<< endl;
+}
+
+// prompt user to select an transaction
+int TransactionList::selectTransaction() {
+	string temp;
+	int index;
+
+	materialize();
+	displayTransactions();
+	cout << "Your selection: ";
+
+	getline(cin, temp);
+	index = atoi(temp.c_str());
+	while (!(index >= 1 && index <= size())) {
+		cout << "Your selection: ";
+		getline(cin, temp);
+		index = atoi(temp.c_str());
+	}
+
+	return index - 1;
+}
+
+void TransactionList::addTransaction(const Transaction &trans) {
+	addTransaction(Transaction(trans));
+}
+
+void TransactionList::addTransaction(Transaction &&trans) {
+	//checking a budget needs the month's total, so load the rows first
+	if (!loaded && budgets.watches(trans)) {
+		materialize();
+	}
+
+	if (loaded) {
+		budgets.apply(trans, 1);
+		if (descriptionsValid) {
+			descriptions.add(trans.getDescription());
+		}
+		std::lock_guard<std::mutex> guard(rowsLock);
+		addToTail(std::move(trans));
+	} else {
+		pending.addToTail(std::move(trans));
+	}
+	//the row is last once loaded, so undo does not need its index
+	record(Edit(EditTruncate, 0, 1));
+	changed();
+}
+
+void TransactionList::appendLoaded(vector<Transaction> &&rows) {
+	std::unique_lock<std::mutex> guard(rowsLock);
+	for (Transaction &trans : rows) {
+		addToTail(std::move(trans));
+	}
+	guard.unlock();
+	colsValid = false;
+	descriptionsValid = false;
+	rebuildBudgets();
+}
+
+//the fields that identify a statement row, viewing a row in the list
+struct RowIdentity {
+	std::string_view date;
+	double amount;
+	std::string_view description;
+
+	explicit RowIdentity(const Transaction &trans) :
+			date(trans.getDate()), amount(trans.getAmount()), description(
+					trans.getDescription()) {
+	}
+
+	bool operator==(const RowIdentity &other) const {
+		return amount == other.amount && date == other.date
+				&& description == other.description;
+	}
+};
+
+struct RowIdentityHash {
+	size_t operator()(const RowIdentity &row) const {
+		size_t h = std::hash<std::string_view>()(row.date);
+		h = h * 1000003 ^ std::hash<double>()(row.amount);
+		h = h * 1000003 ^ std::hash<std::string_view>()(row.description);
+		return h;
+	}
+};
+
+size_t TransactionList::importTransactions(vector<Transaction> &&rows) {
+	//duplicates are checked against every row, so load them
+	materialize();
+
+	//count the rows already there: a statement row is a duplicate only
+	//while an identical row is left to match it, so two same-day purchases
+	//of the same amount both import, and a re-import of both adds neither
+	unordered_map<RowIdentity, size_t, RowIdentityHash> existing;
+	existing.reserve(size());
+	forEach([&existing](const Transaction &trans) {
+		existing[RowIdentity(trans)]++;
+	});
+
+	size_t added = 0;
+	std::unique_lock<std::mutex> guard(rowsLock);
+	for (Transaction &trans : rows) {
+		auto match = existing.find(RowIdentity(trans));
+		if (match != existing.end() && match->second > 0) {
+			match->second--;
+		} else {
+			budgets.apply(trans, 1);
+			if (descriptionsValid) {
+				descriptions.add(trans.getDescription());
+			}
+			addToTail(std::move(trans));
+			added++;
+		}
+	}
+	guard.unlock();
+
+	//one log entry and one autosave snapshot for the whole batch
+	if (added > 0) {
+		record(Edit(EditTruncate, 0, added));
+		changed();
+	}
+	return added;
+}
+
+void TransactionList::modifyTransaction(int index, const Transaction &trans) {
+	modifyTransaction(index, Transaction(trans));
+}
+
+void TransactionList::modifyTransaction(int index, Transaction &&trans) {
+	materialize();
+	if (!(index >= 0 && index < size())) {
+		throw "Invalid transaction index.";
+	}
+
+	budgets.apply(get(index), -1);
+	budgets.apply(trans, 1);
+	if (descriptionsValid) {
+		descriptions.add(trans.getDescription());
+	}
+	Edit edit(EditReplace, index);
+	edit.row = std::move(trans);
+	{
+		std::lock_guard<std::mutex> guard(rowsLock);
+		std::swap(nodeAt(index)->data, edit.row);
+	}
+	record(std::move(edit));
+	changed();
+}
+
+void TransactionList::deleteTransaction(int index) {
+	materialize();
+	if (!(index >= 0 && index < size())) {
+		throw "Invalid transaction index.";
+	}
+
+	//remove transaction at index, keeping it for undo
+	budgets.apply(get(index), -1);
+	Edit edit(EditInsert, index);
+	{
+		std::lock_guard<std::mutex> guard(rowsLock);
+		edit.row = std::move(nodeAt(index)->data);
+		remove(index);
+	}
+	record(std::move(edit));
+	changed();
+}
+
+TransactionList::Edit::Edit(EditKind kind, int index, size_t count) :
+		kind(kind), index(index), count(count) {
+}
+
+void TransactionList::record(Edit &&edit) {
+	redoLog.clear();
+	undoLog.push_back(std::move(edit));
+	if (undoLog.size() > UNDO_LIMIT) {
+		undoLog.pop_front();
+	}
+}
+
+void TransactionList::apply(Edit &edit) {
+	std::lock_guard<std::mutex> guard(rowsLock);
+	switch (edit.kind) {
+	case EditInsert:
+		budgets.apply(edit.row, 1);
+		insert(edit.index, std::move(edit.row));
+		edit.kind = EditErase;
+		break;
+	case EditErase:
+		budgets.apply(get(edit.index), -1);
+		edit.row = std::move(nodeAt(edit.index)->data);
+		remove(edit.index);
+		edit.kind = EditInsert;
+		break;
+	case EditReplace:
+		budgets.apply(get(edit.index), -1);
+		budgets.apply(edit.row, 1);
+		std::swap(nodeAt(edit.index)->data, edit.row);
+		break;
+	case EditTruncate:
+		//rows come off the tail, so store them back to front
+		edit.rows.reserve(edit.count);
+		for (size_t i = 0; i < edit.count; i++) {
+			budgets.apply(tail->data, -1);
+			edit.rows.push_back(std::move(tail->data));
+			removeTail();
+		}
+		std::reverse(edit.rows.begin(), edit.rows.end());
+		edit.kind = EditAppend;
+		break;
+	case EditAppend:
+		for (Transaction &trans : edit.rows) {
+			budgets.apply(trans, 1);
+			addToTail(std::move(trans));
+		}
+		edit.count = edit.rows.size();
+		edit.rows.clear();
+		edit.rows.shrink_to_fit();
+		edit.kind = EditTruncate;
+		break;
+	case EditPermute: {
+		vector<Transaction> rows;
+		moveTo(rows);
+		vector<uint32_t> inverse(edit.order.size());
+		for (size_t i = 0; i < edit.order.size(); i++) {
+			addToTail(std::move(rows[edit.order[i]]));
+			inverse[edit.order[i]] = i;
+		}
+		edit.order.swap(inverse);
+		break;
+	}
+	}
+}
+
+bool TransactionList::undo() {
+	//logged positions refer to the loaded list
+	materialize();
+	if (undoLog.empty()) {
+		return false;
+	}
+
+	Edit edit = std::move(undoLog.back());
+	undoLog.pop_back();
+	apply(edit);
+	redoLog.push_back(std::move(edit));
+	changed();
+	return true;
+}
+
+bool TransactionList::redo() {
+	materialize();
+	if (redoLog.empty()) {
+		return false;
+	}
+
+	Edit edit = std::move(redoLog.back());
+	redoLog.pop_back();
+	apply(edit);
+	undoLog.push_back(std::move(edit));
+	changed();
+	return true;
+}
+
+static string toLower(const string &str) {
+	string temp;
+
+	for (size_t i = 0; i < str.size(); i++) {
+		if (str[i] >= 'A' && str[i] <= 'Z') {
+			temp += (char) (str[i] + 'a' - 'A');
+		} else {
+			temp += str[i];
+		}
+	}
+
+	return temp;
+}
+
+static inline char lowerAscii(char c) {
+	return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+//compare lowerNeedle with the bytes at text, ignoring case
+static inline bool matchesAt(const char *text, std::string_view lowerNeedle) {
+	for (size_t j = 0; j < lowerNeedle.size(); j++) {
+		if (lowerAscii(text[j]) != lowerNeedle[j]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//bits OR-ed into haystack bytes before comparing with c: folds case for
+//letters (non-letters that fold onto c are rejected by matchesAt)
+static inline char caseFold(char c) {
+	return c >= 'a' && c <= 'z' ? 0x20 : 0;
+}
+
+//scan from start with a scalar first-byte filter
+static inline bool containsScalar(std::string_view haystack,
+		std::string_view lowerNeedle, size_t start) {
+	const char first = lowerNeedle[0];
+	const char fold = caseFold(first);
+	size_t end = haystack.size() - lowerNeedle.size();
+	for (size_t i = start; i <= end; i++) {
+		if ((haystack[i] | fold) == first
+				&& matchesAt(haystack.data() + i + 1, lowerNeedle.substr(1))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+//compare the first and last needle bytes 16 positions at a time and verify
+//the candidates. return true on a match; otherwise set next to the first
+//position not yet scanned.
+__attribute__((target("sse2")))
+static bool containsSse2(std::string_view haystack,
+		std::string_view lowerNeedle, size_t &next) {
+	size_t n = lowerNeedle.size();
+	const char *h = haystack.data();
+	const __m128i first = _mm_set1_epi8(lowerNeedle[0]);
+	const __m128i last = _mm_set1_epi8(lowerNeedle[n - 1]);
+	const __m128i firstFold = _mm_set1_epi8(caseFold(lowerNeedle[0]));
+	const __m128i lastFold = _mm_set1_epi8(caseFold(lowerNeedle[n - 1]));
+
+	size_t i = next;
+	for (; i + n - 1 + 16 <= haystack.size(); i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (h + i));
+		__m128i b = _mm_loadu_si128((const __m128i*) (h + i + n - 1));
+		__m128i eq = _mm_and_si128(
+				_mm_cmpeq_epi8(_mm_or_si128(a, firstFold), first),
+				_mm_cmpeq_epi8(_mm_or_si128(b, lastFold), last));
+		unsigned mask = _mm_movemask_epi8(eq);
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			if (matchesAt(h + i + bit, lowerNeedle)) {
+				return true;
+			}
+			mask &= mask - 1;
+		}
+	}
+	next = i;
+	return false;
+}
+
+__attribute__((target("avx2")))
+static bool containsAvx2(std::string_view haystack,
+		std::string_view lowerNeedle, size_t &next) {
+	size_t n = lowerNeedle.size();
+	const char *h = haystack.data();
+	const __m256i first = _mm256_set1_epi8(lowerNeedle[0]);
+	const __m256i last = _mm256_set1_epi8(lowerNeedle[n - 1]);
+	const __m256i firstFold = _mm256_set1_epi8(caseFold(lowerNeedle[0]));
+	const __m256i lastFold = _mm256_set1_epi8(caseFold(lowerNeedle[n - 1]));
+
+	size_t i = next;
+	for (; i + n - 1 + 32 <= haystack.size(); i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) (h + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*) (h + i + n - 1));
+		__m256i eq = _mm256_and_si256(
+				_mm256_cmpeq_epi8(_mm256_or_si256(a, firstFold), first),
+				_mm256_cmpeq_epi8(_mm256_or_si256(b, lastFold), last));
+		unsigned mask = _mm256_movemask_epi8(eq);
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			if (matchesAt(h + i + bit, lowerNeedle)) {
+				return true;
+			}
+			mask &= mask - 1;
+		}
+	}
+	next = i;
+	return false;
+}
+
+static const bool cpuHasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+
+bool containsIgnoreCase(std::string_view haystack,
+		std::string_view lowerNeedle) {
+	if (lowerNeedle.empty()) {
+		return true;
+	}
+	if (lowerNeedle.size() > haystack.size()) {
+		return false;
+	}
+
+	size_t next = 0;
+#if defined(__x86_64__) || defined(__i386__)
+	//vector loops only pay off once a full register of positions fits
+	size_t positions = haystack.size() - lowerNeedle.size() + 1;
+	if (positions >= 32 && cpuHasAvx2
+			&& containsAvx2(haystack, lowerNeedle, next)) {
+		return true;
+	}
+	if (positions - next >= 16 && containsSse2(haystack, lowerNeedle, next)) {
+		return true;
+	}
+#endif
+	return containsScalar(haystack, lowerNeedle, next);
+}
+
+KeywordMatcher::KeywordMatcher(const string &keyword) :
+		lowercase(toLower(keyword)) {
+	for (int i = 0; i < TRANSACTION_CATEGORY_COUNT; i++) {
+		categories[i] = CATEGORY_NAMES_LOWER[i].find(lowercase)
+				!= std::string_view::npos;
+	}
+}
+
+bool KeywordMatcher::matches(int category, std::string_view description,
+		std::string_view date) const {
+	return categories[category] || containsIgnoreCase(description, lowercase)
+			|| containsIgnoreCase(date, lowercase);
+}
+
+void TransactionList::searchTransaction(const string &keyword, Queue &queue) {
+	materialize();
+	findTransactions(keyword, queue);
+}
+
+void TransactionList::findTransactions(const string &keyword,
+		Queue &queue) const {
+	KeywordMatcher matcher(keyword);
+
+	//stream the category and description columns; descriptions are the
+	//long field, so they get the vector scan straight from the shared
+	//string buffer. dates are matched and rows returned as stored, since
+	//the date column only holds what parses as DD/MM/YYYY.
+	const TransactionColumns &c = columns();
+	size_t i = 0;
+	forEach([&](const Transaction &trans) {
+		if (matcher.matches(c.category(i), c.description(i),
+				trans.getDate())) {
+			queue.push(trans);
+		}
+		i++;
+	});
+}
+
+void TransactionList::displayTransactions() {
+	materialize();
+	std::shared_ptr<Node> node = head;
+	int i = 0;
+	while (node) {
+		cout.setf(ios::right);
+		cout << setw(2) << (i + 1) << ". ";
+		cout.unsetf(ios::right);
+		node->data.print();
+
+		node = node->next;
+		i++;
+	}
+}
+
+void TransactionList::sortTransactions() {
+	sortTransactions( { { SortByDate, true } });
+}
+
+void TransactionList::sortTransactions(const vector<SortColumn> &sortColumns) {
+	materialize();
+	vector<uint32_t> order = radixOrder(columns(), sortColumns);
+
+	//rebuild the list in that order; the log keeps the permutation, not rows
+	Edit edit(EditPermute);
+	edit.order = std::move(order);
+	apply(edit);
+	record(std::move(edit));
+	changed();
+}
+
+BudgetTracker::BudgetTracker() {
+	for (double &limit : limits) {
+		limit = 0;
+	}
+}
+
+uint32_t BudgetTracker::keyOf(const Transaction &trans) {
+	return trans.getDateKey() / 100 * 16 + trans.getCategoryInt();
+}
+
+void BudgetTracker::setLimits(const double newLimits[TRANSACTION_CATEGORY_COUNT]) {
+	for (int i = 0; i < TRANSACTION_CATEGORY_COUNT; i++) {
+		limits[i] = newLimits[i];
+	}
+}
+
+void BudgetTracker::setLimit(TransactionCategory category, double limit) {
+	limits[category] = limit;
+}
+
+double BudgetTracker::getLimit(TransactionCategory category) const {
+	return limits[category];
+}
+
+bool BudgetTracker::active() const {
+	for (double limit : limits) {
+		if (limit > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool BudgetTracker::watches(const Transaction &trans) const {
+	int category = trans.getCategoryInt();
+	return trans.getTypeInt() == Expense && category >= 0
+			&& category < TRANSACTION_CATEGORY_COUNT && limits[category] > 0;
+}
+
+void BudgetTracker::reset() {
+	spent.clear();
+	alerts.clear();
+}
+
+void BudgetTracker::apply(const Transaction &trans, int sign) {
+	if (!watches(trans)) {
+		return;
+	}
+
+	double &total = spent[keyOf(trans)];
+	double before = total;
+	total += sign * trans.getAmount();
+
+	//alert once, when the month goes over the budget, not on every later
+	//expense
+	double limit = limits[trans.getCategoryInt()];
+	if (sign > 0 && before <= limit && total > limit) {
+		const string &date = trans.getDate();
+		ostringstream oss;
+		oss.setf(ios::fixed);
+		oss << setprecision(2);
+		oss << "Budget alert: " << trans.getCategory() << " spending in "
+				<< (date.size() >= 10 ? date.substr(3) : date) << " is "
+				<< total << ", over the budget of " << limit << ".";
+		alerts.push_back(oss.str());
+	}
+}
+
+vector<string> BudgetTracker::takeAlerts() {
+	vector<string> taken;
+	taken.swap(alerts);
+	return taken;
+}
+
+bool parseAmount(std::string_view text, double &amount) {
+	while (!text.empty() && isspace((unsigned char) text.front())) {
+		text.remove_prefix(1);
+	}
+	if (!text.empty() && text.front() == '+') {
+		text.remove_prefix(1);
+	}
+	if (text.empty()) {
+		return false;
+	}
+	std::from_chars_result result = std::from_chars(text.data(),
+			text.data() + text.size(), amount);
+	//from_chars also takes "inf" and "nan"
+	return result.ec == std::errc() && result.ptr == text.data() + text.size()
+			&& std::isfinite(amount);
+}
+
+ImportResult::ImportResult() :
+		parsed(0), invalid(0), imported(0) {
+}
+
+StatementImporter::StatementImporter() :
+		dateColumn(-1), descriptionColumn(-1), amountColumn(-1), typeColumn(
+				-1), categoryColumn(-1) {
+}
+
+void StatementImporter::splitCsv(std::string_view line,
+		vector<string> &fields) {
+	fields.clear();
+	fields.emplace_back();
+	bool quoted = false;
+	for (size_t i = 0; i < line.size(); i++) {
+		char c = line[i];
+		if (quoted) {
+			if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+				fields.back() += '"';
+				i++;
+			} else if (c == '"') {
+				quoted = false;
+			} else {
+				fields.back() += c;
+			}
+		} else if (c == '"') {
+			quoted = true;
+		} else if (c == ',') {
+			fields.emplace_back();
+		} else if (c != '\r') {
+			fields.back() += c;
+		}
+	}
+}
+
+bool StatementImporter::mapColumns(std::string_view header) {
+	vector<string> names;
+	splitCsv(header, names);
+	for (size_t i = 0; i < names.size(); i++) {
+		string name = names[i];
+		name.erase(0, name.find_first_not_of(" \t"));
+		name.erase(name.find_last_not_of(" \t") + 1);
+		if (equalsIgnoreCase(name, "date")) {
+			dateColumn = i;
+		} else if (equalsIgnoreCase(name, "description")
+				|| equalsIgnoreCase(name, "memo")
+				|| equalsIgnoreCase(name, "details")) {
+			descriptionColumn = i;
+		} else if (equalsIgnoreCase(name, "amount")) {
+			amountColumn = i;
+		} else if (equalsIgnoreCase(name, "type")) {
+			typeColumn = i;
+		} else if (equalsIgnoreCase(name, "category")) {
+			categoryColumn = i;
+		}
+	}
+	return dateColumn >= 0 && amountColumn >= 0;
+}
+
+bool StatementImporter::parseLine(std::string_view line,
+		const string &username, vector<string> &fields,
+		Transaction &trans) const {
+	splitCsv(line, fields);
+	int needed = std::max( { dateColumn, descriptionColumn, amountColumn,
+			typeColumn, categoryColumn });
+	if ((int) fields.size() <= needed) {
+		return false;
+	}
+
+	double amount;
+	if (!App::validateDate(fields[dateColumn])
+			|| !parseAmount(fields[amountColumn], amount)) {
+		return false;
+	}
+
+	int type = amount < 0 ? Expense : Income;
+	if (typeColumn >= 0) {
+		type = typeFromName(fields[typeColumn]);
+		if (type < 0) {
+			return false;
+		}
+	}
+
+	int category = type == Income ? Cash : Other;
+	if (categoryColumn >= 0 && !fields[categoryColumn].empty()) {
+		category = categoryFromName(fields[categoryColumn]);
+		if (category < 0 || (type == Income) != (category <= Gift)) {
+			return false;
+		}
+	}
+
+	string description;
+	if (descriptionColumn >= 0) {
+		//commas would break the transactions.csv line format
+		description = std::move(fields[descriptionColumn]);
+		std::replace(description.begin(), description.end(), ',', ';');
+	}
+
+	trans = Transaction(username, (TransactionType) type,
+			std::move(fields[dateColumn]), (TransactionCategory) category,
+			std::move(description), amount < 0 ? -amount : amount);
+	return true;
+}
+
+ImportResult StatementImporter::readFile(const string &filename,
+		const string &username, vector<Transaction> &rows) {
+	string text;
+	if (!readFileImage(filename, text)) {
+		throw FileException("Failed to open file " + filename + ".");
+	}
+
+	//index the lines once, then hand out contiguous batches
+	vector<std::string_view> lines;
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t nl = text.find('\n', pos);
+		if (nl == string::npos) {
+			nl = text.size();
+		}
+		if (nl > pos) {
+			lines.emplace_back(text.data() + pos, nl - pos);
+		}
+		pos = nl + 1;
+	}
+	if (lines.empty() || !mapColumns(lines[0])) {
+		throw FileException("Statement needs date and amount columns.");
+	}
+
+	size_t dataLines = lines.size() - 1;
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, dataLines / 10000 + 1);
+	vector<vector<Transaction>> batches(threadCount);
+	vector<size_t> invalid(threadCount, 0);
+	runParallel(threadCount, [&](size_t t) {
+		size_t first = 1 + dataLines * t / threadCount;
+		size_t last = 1 + dataLines * (t + 1) / threadCount;
+		vector<string> fields;
+		batches[t].reserve(last - first);
+		for (size_t i = first; i < last; i++) {
+			Transaction trans;
+			if (parseLine(lines[i], username, fields, trans)) {
+				batches[t].push_back(std::move(trans));
+			} else {
+				invalid[t]++;
+			}
+		}
+	});
+
+	//keep statement order
+	ImportResult result;
+	for (size_t t = 0; t < threadCount; t++) {
+		result.parsed += batches[t].size();
+		result.invalid += invalid[t];
+		rows.insert(rows.end(), std::make_move_iterator(batches[t].begin()),
+				std::make_move_iterator(batches[t].end()));
+	}
+	return result;
+}
+
+GroupTotal::GroupTotal() :
+		month(0), category(-1), count(0), income(0), expense(0) {
+}
+
+double GroupTotal::average() const {
+	return count ? (income + expense) / count : 0;
+}
+
+size_t TransactionList::memoryUsage(vector<MemoryUsage> &out) const {
+	MemoryUsage store = RowList::memoryUsage("transaction store");
+	store.perRow = true;
+	out.push_back(store);
+
+	//each partition also costs a map node holding its key and list head
+	MemoryUsage other("other users", 0, 0, true);
+	for (const auto &partition : others) {
+		MemoryUsage rows = partition.second.memoryUsage(partition.first);
+		other.objects += rows.objects;
+		other.bytes += rows.bytes + mapNodeBytes<decltype(others)>()
+				+ heapBytes(partition.first);
+	}
+	out.push_back(other);
+	MemoryUsage added = pending.memoryUsage("pending rows");
+	added.perRow = true;
+	out.push_back(added);
+
+	MemoryUsage history("undo history", undoLog.size() + redoLog.size());
+	for (const deque<Edit> *log : { &undoLog, &redoLog }) {
+		for (const Edit &edit : *log) {
+			history.bytes += sizeof(Edit) + edit.row.heapBytes()
+					+ edit.rows.capacity() * sizeof(Transaction)
+					+ edit.order.capacity() * sizeof(uint32_t);
+			for (const Transaction &trans : edit.rows) {
+				history.bytes += trans.heapBytes();
+			}
+		}
+	}
+	out.push_back(history);
+
+	out.emplace_back("description index", descriptions.size(),
+			descriptions.memoryBytes(), true);
+
+	std::lock_guard<std::mutex> lock(colsLock);
+	out.emplace_back("column index", colsValid ? cols.size() : 0,
+			cols.memoryBytes(), true);
+	return store.objects + other.objects + added.objects;
+}
+
+vector<string> TransactionList::completeDescription(const string &prefix,
+		size_t count) {
+	materialize();
+	if (!descriptionsValid) {
+		//first completion since a user switch
+		descriptions.clear();
+		std::shared_ptr<Node> node = head;
+		while (node) {
+			descriptions.add(node->data.getDescription());
+			node = node->next;
+		}
+		descriptionsValid = true;
+	}
+	return descriptions.complete(prefix, count);
+}
+
+//totals of rows grouped by fields; each row comes with the index of its
+//user in users
+static void groupRows(int fields, const vector<const string*> &users,
+		const vector<std::pair<const Transaction*, uint32_t>> &rows,
+		vector<GroupTotal> &out) {
+	//group key: user in the high 32 bits, then YYYYMM * 16 + category
+	auto keyOf = [fields](const Transaction &trans, uint32_t user) {
+		uint64_t key = 0;
+		if (fields & GroupByUser) {
+			key = (uint64_t) user << 32;
+		}
+		if (fields & GroupByMonth) {
+			key |= (uint64_t) (trans.getDateKey() / 100) << 4;
+		}
+		if (fields & GroupByCategory) {
+			key |= trans.getCategoryInt();
+		}
+		return key;
+	};
+
+	struct Partial {
+		size_t count = 0;
+		double income = 0;
+		double expense = 0;
+	};
+	typedef unordered_map<uint64_t, Partial> Table;
+
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, rows.size() / 50000 + 1);
+	vector<Table> tables(threadCount);
+	runParallel(threadCount, [&](size_t t) {
+		size_t first = rows.size() * t / threadCount;
+		size_t last = rows.size() * (t + 1) / threadCount;
+		Table &table = tables[t];
+		for (size_t i = first; i < last; i++) {
+			const Transaction &trans = *rows[i].first;
+			Partial &partial = table[keyOf(trans, rows[i].second)];
+			partial.count++;
+			(trans.getTypeInt() == Income ? partial.income : partial.expense) +=
+					trans.getAmount();
+		}
+	});
+
+	//merge the partial tables into the first
+	for (size_t t = 1; t < threadCount; t++) {
+		for (const auto &entry : tables[t]) {
+			Partial &partial = tables[0][entry.first];
+			partial.count += entry.second.count;
+			partial.income += entry.second.income;
+			partial.expense += entry.second.expense;
+		}
+	}
+
+	out.clear();
+	out.reserve(tables[0].size());
+	for (const auto &entry : tables[0]) {
+		GroupTotal group;
+		if (fields & GroupByUser) {
+			group.username = *users[entry.first >> 32];
+		}
+		if (fields & GroupByMonth) {
+			group.month = (entry.first >> 4) & 0xfffffff;
+		}
+		if (fields & GroupByCategory) {
+			group.category = entry.first & 0xf;
+		}
+		group.count = entry.second.count;
+		group.income = entry.second.income;
+		group.expense = entry.second.expense;
+		out.push_back(std::move(group));
+	}
+	std::sort(out.begin(), out.end(),
+			[](const GroupTotal &a, const GroupTotal &b) {
+				if (a.username != b.username) {
+					return a.username < b.username;
+				}
+				if (a.month != b.month) {
+					return a.month < b.month;
+				}
+				return a.category < b.category;
+			});
+}
+
+void TransactionList::groupTotals(int fields, vector<GroupTotal> &out) {
+	materialize();
+
+	//number the users by partition, so rows need no string hashing
+	vector<const string*> users;
+	vector<std::pair<const Transaction*, uint32_t>> rows;
+	rows.reserve(size());
+	auto addPartition = [&](const string &username,
+			const RowList &list) {
+		uint32_t user = users.size();
+		users.push_back(&username);
+		list.forEach([&](const Transaction &trans) {
+			rows.emplace_back(&trans, user);
+		});
+	};
+	addPartition(currentUser, *this);
+	for (const auto &partition : others) {
+		addPartition(partition.first, partition.second);
+	}
+	groupRows(fields, users, rows, out);
+}
+
+void TransactionList::topTransactions(RankOrder order, int k, Queue &queue) {
+	materialize();
+	findTop(order, k, queue);
+}
+
+void TransactionList::findTop(RankOrder order, int k, Queue &queue) const {
+	if (k <= 0) {
+		return;
+	}
+
+	//better(a, b): row a ranks before row b
+	const TransactionColumns &c = columns();
+	auto better = [&c, order](uint32_t a, uint32_t b) {
+		if (order == LatestFirst) {
+			if (c.date(a) != c.date(b)) {
+				return c.date(a) > c.date(b);
+			}
+			return a > b; //rows added later are more recent
+		}
+		if (c.amount(a) != c.amount(b)) {
+			return c.amount(a) > c.amount(b);
+		}
+		return a < b;
+	};
+
+	//heap of the best k rows so far, with the worst of them on top
+	vector<uint32_t> heap;
+	heap.reserve(std::min<size_t>(k, c.size()));
+	for (size_t i = 0; i < c.size(); i++) {
+		if (order == LargestExpenseFirst && c.type(i) != Expense) {
+			continue;
+		}
+		if (heap.size() < (size_t) k) {
+			heap.push_back(i);
+			std::push_heap(heap.begin(), heap.end(), better);
+		} else if (better(i, heap.front())) {
+			std::pop_heap(heap.begin(), heap.end(), better);
+			heap.back() = i;
+			std::push_heap(heap.begin(), heap.end(), better);
+		}
+	}
+
+	std::sort_heap(heap.begin(), heap.end(), better);
+	for (const Transaction *trans : rowsAt(heap)) {
+		queue.push(*trans);
+	}
+}
+
+vector<const Transaction*> TransactionList::rowsAt(
+		const vector<uint32_t> &positions) const {
+	vector<uint32_t> sorted(positions);
+	std::sort(sorted.begin(), sorted.end());
+	vector<const Transaction*> found(sorted.size());
+	size_t next = 0;
+	uint32_t position = 0;
+	std::shared_ptr<Node> node = head;
+	while (node && next < sorted.size()) {
+		while (next < sorted.size() && sorted[next] == position) {
+			found[next++] = &node->data;
+		}
+		node = node->next;
+		position++;
+	}
+
+	vector<const Transaction*> rows;
+	rows.reserve(positions.size());
+	for (uint32_t p : positions) {
+		rows.push_back(
+				found[std::lower_bound(sorted.begin(), sorted.end(), p)
+						- sorted.begin()]);
+	}
+	return rows;
+}
+
+const TransactionColumns& TransactionList::columns() const {
+	std::lock_guard<std::mutex> lock(colsLock);
+	if (!colsValid) {
+		cols.clear();
+		cols.reserve(size());
+		std::shared_ptr<Node> node = head;
+		while (node) {
+			cols.append(node->data);
+			node = node->next;
+		}
+		colsValid = true;
+	}
+	return cols;
+}
+
+double TransactionList::totalAmount(TransactionType type) const {
+	const TransactionColumns &c = columns();
+	double total = 0;
+	for (size_t i = 0; i < c.size(); i++) {
+		if (c.type(i) == type) {
+			total += c.amount(i);
+		}
+	}
+	return total;
+}
+
+void TransactionColumns::clear() {
+	types.clear();
+	categories.clear();
+	dates.clear();
+	amounts.clear();
+	strings.clear();
+	usernames.clear();
+	descriptions.clear();
+}
+
+void TransactionColumns::reserve(size_t rows) {
+	types.reserve(rows);
+	categories.reserve(rows);
+	dates.reserve(rows);
+	amounts.reserve(rows);
+	usernames.reserve(rows);
+	descriptions.reserve(rows);
+}
+
+TransactionColumns::StringRef TransactionColumns::addString(
+		const string &value) {
+	StringRef ref = { (uint32_t) strings.size(), (uint32_t) value.size() };
+	strings += value;
+	return ref;
+}
+
+void TransactionColumns::append(const Transaction &trans) {
+	int category = trans.getCategoryInt();
+	if (category < 0 || category >= TRANSACTION_CATEGORY_COUNT) {
+		category = Other;
+	}
+	types.push_back(trans.getTypeInt());
+	categories.push_back(category);
+	dates.push_back(trans.getDateKey());
+	amounts.push_back(trans.getAmount());
+	usernames.push_back(addString(trans.getUsername()));
+	descriptions.push_back(addString(trans.getDescription()));
+}
+
+size_t TransactionColumns::memoryBytes() const {
+	return types.capacity() + categories.capacity()
+			+ dates.capacity() * sizeof(uint32_t)
+			+ amounts.capacity() * sizeof(double) + ::heapBytes(strings)
+			+ (usernames.capacity() + descriptions.capacity())
+					* sizeof(StringRef);
+}
+
+size_t TransactionColumns::size() const {
+	return types.size();
+}
+
+TransactionType TransactionColumns::type(size_t row) const {
+	return (TransactionType) types[row];
+}
+
+TransactionCategory TransactionColumns::category(size_t row) const {
+	return (TransactionCategory) categories[row];
+}
+
+uint32_t TransactionColumns::date(size_t row) const {
+	return dates[row];
+}
+
+double TransactionColumns::amount(size_t row) const {
+	return amounts[row];
+}
+
+std::string_view TransactionColumns::username(size_t row) const {
+	return std::string_view(strings).substr(usernames[row].offset,
+			usernames[row].length);
+}
+
+std::string_view TransactionColumns::description(size_t row) const {
+	return std::string_view(strings).substr(descriptions[row].offset,
+			descriptions[row].length);
+}
+
+void TransactionColumns::formatDate(size_t row, char *out) const {
+	uint32_t key = dates[row];
+	uint32_t y = key / 10000, m = key / 100 % 100, d = key % 100;
+	out[0] = '0' + d / 10;
+	out[1] = '0' + d % 10;
+	out[2] = '/';
+	out[3] = '0' + m / 10;
+	out[4] = '0' + m % 10;
+	out[5] = '/';
+	out[6] = '0' + y / 1000 % 10;
+	out[7] = '0' + y / 100 % 10;
+	out[8] = '0' + y / 10 % 10;
+	out[9] = '0' + y % 10;
+}
+
+//bits the packed key of a SortField takes
+static unsigned sortKeyBits(SortField field) {
+	switch (field) {
+	case SortByDate:
+		return 27; //YYYYMMDD <= 99991231
+	case SortByCategory:
+		return 4;
+	case SortByType:
+		return 1;
+	case SortByAmount:
+		return 64;
+	}
+	return 0;
+}
+
+//order-preserving unsigned encoding of a double: flip the sign bit of
+//positive values and every bit of negative ones
+static uint64_t sortableAmount(double amount) {
+	uint64_t bits;
+	memcpy(&bits, &amount, sizeof(bits));
+	return bits >> 63 ? ~bits : bits | (uint64_t) 1 << 63;
+}
+
+//pack sort columns [first, last) of the rows in order into keys, first
+//column highest
+static void packSortKeys(const TransactionColumns &cols,
+		vector<SortColumn>::const_iterator first,
+		vector<SortColumn>::const_iterator last,
+		const vector<uint32_t> &order, vector<uint64_t> &keys) {
+	keys.assign(order.size(), 0);
+	for (; first != last; ++first) {
+		const SortColumn &column = *first;
+		unsigned bits = sortKeyBits(column.field);
+		uint64_t mask = bits == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << bits) - 1;
+		uint64_t flip = column.descending ? mask : 0;
+		for (size_t i = 0; i < keys.size(); i++) {
+			uint32_t row = order[i];
+			uint64_t value;
+			switch (column.field) {
+			case SortByDate:
+				value = cols.date(row);
+				break;
+			case SortByCategory:
+				value = cols.category(row);
+				break;
+			case SortByType:
+				value = cols.type(row);
+				break;
+			default:
+				value = sortableAmount(cols.amount(row));
+				break;
+			}
+			//shift in two steps: a 64-bit shift of a 64-bit key is undefined
+			keys[i] = (keys[i] << (bits - 1) << 1) | ((value & mask) ^ flip);
+		}
+	}
+}
+
+//stable LSD radix sort of keys (the low bits bits are used), carrying order
+static void radixSort(vector<uint64_t> &keys, vector<uint32_t> &order,
+		unsigned bits) {
+	size_t n = keys.size();
+	vector<uint64_t> keyBuf(n);
+	vector<uint32_t> orderBuf(n);
+	for (unsigned shift = 0; shift < bits && n > 0; shift += 8) {
+		size_t counts[256] = { 0 };
+		for (size_t i = 0; i < n; i++) {
+			counts[(uint8_t) (keys[i] >> shift)]++;
+		}
+		//a byte every key shares does not change the order
+		if (counts[(uint8_t) (keys[0] >> shift)] == n) {
+			continue;
+		}
+
+		size_t pos = 0;
+		for (size_t &count : counts) {
+			size_t c = count;
+			count = pos;
+			pos += c;
+		}
+		for (size_t i = 0; i < n; i++) {
+			size_t dest = counts[(uint8_t) (keys[i] >> shift)]++;
+			keyBuf[dest] = keys[i];
+			orderBuf[dest] = order[i];
+		}
+		keys.swap(keyBuf);
+		order.swap(orderBuf);
+	}
+}
+
+DescriptionIndex::Node::Node(string label) :
+		label(std::move(label)), entry(-1), topCount(0) {
+}
+
+DescriptionIndex::DescriptionIndex() {
+	clear();
+}
+
+void DescriptionIndex::clear() {
+	nodes.clear();
+	entries.clear();
+	nodes.emplace_back("");
+	useCount = 0;
+}
+
+bool DescriptionIndex::before(uint32_t a, uint32_t b) const {
+	if (entries[a].uses != entries[b].uses) {
+		return entries[a].uses > entries[b].uses;
+	}
+	return entries[a].lastUse > entries[b].lastUse;
+}
+
+void DescriptionIndex::raise(uint32_t node, uint32_t entry) {
+	//uses only grow, so entry can only move up or come in
+	Node &n = nodes[node];
+	size_t pos = 0;
+	while (pos < n.topCount && n.top[pos] != entry) {
+		pos++;
+	}
+	if (pos == n.topCount) {
+		if (n.topCount < SUGGESTION_COUNT) {
+			n.topCount++;
+		} else if (before(entry, n.top[pos - 1])) {
+			pos--;
+		} else {
+			return;
+		}
+	}
+	while (pos > 0 && before(entry, n.top[pos - 1])) {
+		n.top[pos] = n.top[pos - 1];
+		pos--;
+	}
+	n.top[pos] = entry;
+}
+
+uint32_t DescriptionIndex::childStarting(uint32_t node, char c) const {
+	for (uint32_t child : nodes[node].children) {
+		if (nodes[child].label[0] == c) {
+			return child;
+		}
+	}
+	return 0;
+}
+
+void DescriptionIndex::add(const string &description) {
+	string key = toLower(description);
+
+	//walk down, splitting the edge where key leaves it
+	vector<uint32_t> path(1, 0);
+	uint32_t node = 0;
+	size_t pos = 0;
+	while (pos < key.size()) {
+		uint32_t child = childStarting(node, key[pos]);
+		if (child == 0) {
+			nodes.emplace_back(key.substr(pos));
+			child = nodes.size() - 1;
+			nodes[node].children.push_back(child);
+			path.push_back(child);
+			node = child;
+			break;
+		}
+
+		const string &label = nodes[child].label;
+		size_t common = 1;
+		while (common < label.size() && pos + common < key.size()
+				&& label[common] == key[pos + common]) {
+			common++;
+		}
+		if (common < label.size()) {
+			//the new middle node has the same descriptions below it
+			Node middle(label.substr(0, common));
+			middle.children.push_back(child);
+			memcpy(middle.top, nodes[child].top, sizeof(middle.top));
+			middle.topCount = nodes[child].topCount;
+			nodes[child].label.erase(0, common);
+			nodes.push_back(std::move(middle));
+			uint32_t id = nodes.size() - 1;
+			std::replace(nodes[node].children.begin(),
+					nodes[node].children.end(), child, id);
+			child = id;
+		}
+		path.push_back(child);
+		node = child;
+		pos += common;
+	}
+
+	if (nodes[node].entry < 0) {
+		nodes[node].entry = entries.size();
+		entries.push_back( { description, 0, 0 });
+	}
+	uint32_t entry = nodes[node].entry;
+	entries[entry].uses++;
+	entries[entry].lastUse = ++useCount;
+	for (uint32_t id : path) {
+		raise(id, entry);
+	}
+}
+
+vector<string> DescriptionIndex::complete(const string &prefix,
+		size_t count) const {
+	string key = toLower(prefix);
+	uint32_t node = 0;
+	size_t pos = 0;
+	while (pos < key.size()) {
+		uint32_t child = childStarting(node, key[pos]);
+		if (child == 0) {
+			return vector<string>();
+		}
+		const string &label = nodes[child].label;
+		size_t common = 1;
+		while (common < label.size() && pos + common < key.size()
+				&& label[common] == key[pos + common]) {
+			common++;
+		}
+		if (pos + common < key.size() && common < label.size()) {
+			return vector<string>();
+		}
+		node = child;
+		pos += common;
+	}
+
+	vector<string> out;
+	const Node &n = nodes[node];
+	for (size_t i = 0; i < n.topCount && i < count; i++) {
+		out.push_back(entries[n.top[i]].text);
+	}
+	return out;
+}
+
+size_t DescriptionIndex::size() const {
+	return entries.size();
+}
+
+size_t DescriptionIndex::memoryBytes() const {
+	size_t bytes = nodes.capacity() * sizeof(Node)
+			+ entries.capacity() * sizeof(Entry);
+	for (const Node &node : nodes) {
+		bytes += heapBytes(node.label)
+				+ node.children.capacity() * sizeof(uint32_t);
+	}
+	for (const Entry &entry : entries) {
+		bytes += heapBytes(entry.text);
+	}
+	return bytes;
+}
+
+vector<uint32_t> radixOrder(const TransactionColumns &cols,
+		const vector<SortColumn> &columns) {
+	vector<uint32_t> order(cols.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+
+	//columns that do not fit one 64-bit key are sorted in groups, last
+	//group first: each pass is stable, so earlier groups take precedence
+	vector<uint64_t> keys;
+	auto last = columns.end();
+	while (last != columns.begin()) {
+		auto first = last;
+		unsigned bits = 0;
+		while (first != columns.begin()
+				&& bits + sortKeyBits((first - 1)->field) <= 64) {
+			--first;
+			bits += sortKeyBits(first->field);
+		}
+		packSortKeys(cols, first, last, order, keys);
+		radixSort(keys, order, bits);
+		last = first;
+	}
+	return order;
+}
+
+bool TransactionColumns::appendLine(std::string_view line, bool &exact) {
+	//fields: username,type,date,category,description,amount
+	size_t commas[5];
+	size_t pos = 0;
+	for (size_t &comma : commas) {
+		comma = line.find(',', pos);
+		if (comma == string::npos) {
+			return false;
+		}
+		pos = comma + 1;
+	}
+	if (pos >= line.size()) {
+		return false;
+	}
+
+	const char *p = line.data();
+	int type = atoi(p + commas[0] + 1);
+	int category = atoi(p + commas[2] + 1);
+	std::string_view date = line.substr(commas[1] + 1,
+			commas[2] - commas[1] - 1);
+	uint32_t key = 0;
+	if (date.size() == 10 && date[2] == '/' && date[5] == '/') {
+		for (size_t i : { 6, 7, 8, 9, 3, 4, 0, 1 }) {
+			if (date[i] < '0' || date[i] > '9') {
+				exact = false;
+			}
+			key = key * 10 + (date[i] - '0');
+		}
+	} else {
+		exact = false;
+	}
+	if (type != Income && type != Expense) {
+		exact = false;
+	}
+	if (category < 0 || category >= TRANSACTION_CATEGORY_COUNT) {
+		category = Other;
+		exact = false;
+	}
+
+	types.push_back(type);
+	categories.push_back(category);
+	dates.push_back(key);
+	//amounts are written by to_chars, which from_chars reads back exactly
+	double amount;
+	if (std::from_chars(p + pos, line.data() + line.size(), amount).ec
+			!= std::errc()) {
+		amount = atof(p + pos);
+	}
+	amounts.push_back(amount);
+	StringRef ref = { (uint32_t) strings.size(), (uint32_t) commas[0] };
+	strings.append(p, commas[0]);
+	usernames.push_back(ref);
+	ref = { (uint32_t) strings.size(),
+			(uint32_t) (commas[4] - commas[3] - 1) };
+	strings.append(p + commas[3] + 1, ref.length);
+	descriptions.push_back(ref);
+	return true;
+}
+
+void TransactionColumns::writeImage(string &out) const {
+	out.reserve(out.size() + 8 + 2 * (size() + 8) + size() * 4 + 8
+			+ size() * (sizeof(double) + 2 * sizeof(StringRef))
+			+ strings.size() + 8);
+	appendRaw(out, (uint32_t) size());
+	appendRaw(out, (uint32_t) strings.size());
+	out.append((const char*) types.data(), types.size());
+	padTo8(out);
+	out.append((const char*) categories.data(), categories.size());
+	padTo8(out);
+	out.append((const char*) dates.data(), dates.size() * sizeof(uint32_t));
+	padTo8(out);
+	out.append((const char*) amounts.data(), amounts.size() * sizeof(double));
+	out.append((const char*) usernames.data(),
+			usernames.size() * sizeof(StringRef));
+	out.append((const char*) descriptions.data(),
+			descriptions.size() * sizeof(StringRef));
+	out += strings;
+	padTo8(out);
+}
+
+bool TransactionColumns::readImage(const char *data, size_t size) {
+	uint32_t rows, stringBytes;
+	if (size < 8) {
+		return false;
+	}
+	memcpy(&rows, data, sizeof(rows));
+	memcpy(&stringBytes, data + 4, sizeof(stringBytes));
+	size_t padded = (rows + 7) / 8 * 8;
+	size_t datesSize = (rows * sizeof(uint32_t) + 7) / 8 * 8;
+	size_t need = 8 + 2 * padded + datesSize + rows * sizeof(double)
+			+ 2 * rows * sizeof(StringRef) + stringBytes;
+	if (size < need) {
+		return false;
+	}
+
+	clear();
+	const char *p = data + 8;
+	types.assign(p, p + rows);
+	p += padded;
+	categories.assign(p, p + rows);
+	p += padded;
+	dates.resize(rows);
+	memcpy(dates.data(), p, rows * sizeof(uint32_t));
+	p += datesSize;
+	amounts.resize(rows);
+	memcpy(amounts.data(), p, rows * sizeof(double));
+	p += rows * sizeof(double);
+	usernames.resize(rows);
+	memcpy(usernames.data(), p, rows * sizeof(StringRef));
+	p += rows * sizeof(StringRef);
+	descriptions.resize(rows);
+	memcpy(descriptions.data(), p, rows * sizeof(StringRef));
+	p += rows * sizeof(StringRef);
+	strings.assign(p, stringBytes);
+
+	//every reference must stay inside the string bytes
+	for (size_t i = 0; i < rows; i++) {
+		if ((uint64_t) usernames[i].offset + usernames[i].length > stringBytes
+				|| (uint64_t) descriptions[i].offset + descriptions[i].length
+						> stringBytes
+				|| categories[i] >= TRANSACTION_CATEGORY_COUNT) {
+			clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+Transaction TransactionColumns::row(size_t row) const {
+	char date[10];
+	formatDate(row, date);
+	return Transaction(string(username(row)), type(row), string(date, 10),
+			category(row), string(description(row)), amount(row));
+}
+
+Ledger::Ledger() {
+}
+
+Ledger::Partition* Ledger::find(const string &username) const {
+	std::shared_lock<std::shared_mutex> lock(partitionsLock);
+	auto it = partitions.find(username);
+	return it == partitions.end() ? nullptr : it->second.get();
+}
+
+Ledger::Partition& Ledger::findOrCreate(const string &username) {
+	Partition *partition = find(username);
+	if (partition) {
+		return *partition;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(partitionsLock);
+	unique_ptr<Partition> &slot = partitions[username];
+	if (!slot) {
+		slot.reset(new Partition());
+		slot->rows.setCurrentUser(username);
+	}
+	return *slot;
+}
+
+void Ledger::loadFile(const string &filename) {
+	FileLock lock(filename, false);
+	string text = readTransactionFile(filename);
+
+	//group the rows by user, then hand each partition its rows at once
+	map<string, vector<Transaction>> users;
+	string line;
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t nl = text.find('\n', pos);
+		if (nl == string::npos) {
+			nl = text.size();
+		}
+		line.assign(text, pos, nl - pos);
+		pos = nl + 1;
+
+		Transaction trans;
+		if (trans.readLine(line)) {
+			users[trans.getUsername()].push_back(std::move(trans));
+		}
+	}
+	for (auto &user : users) {
+		write(user.first, [&user](TransactionList &rows) {
+			rows.appendLoaded(std::move(user.second));
+		});
+	}
+}
+
+void Ledger::saveFile(const string &filename) const {
+	string text;
+	formatRows(text);
+	FileLock lock(filename, true);
+	writeTransactionFile(filename, text);
+}
+
+void Ledger::formatRows(string &out) const {
+	std::shared_lock<std::shared_mutex> mapLock(partitionsLock);
+	for (const auto &entry : partitions) {
+		std::shared_lock<std::shared_mutex> rowsLock(entry.second->lock);
+		entry.second->rows.forEach([&out](const Transaction &trans) {
+			out += formatTransaction(trans);
+			out += '\n';
+		});
+	}
+}
+
+UserList::UserList() {
+
+}
+
+bool UserList::hasUser(const string &username) const {
+	for (const User &u : users) {
+		if (u.getUsername() == username) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void UserList::addUser(const string &username, const string &password,
+		bool admin) {
+	users.emplace_back(username, password, admin);
+}
+
+bool UserList::login(const string &username, const string &password,
+		bool &admin) const {
+	admin = false;
+	string passwordEncrypted = User::hash(password);
+
+	for (const User &u : users) {
+		if (u.getUsername() == username
+				&& u.getPassword() == passwordEncrypted) {
+			admin = u.isAdmin();
+			return true;
+		}
+	}
+	return false;
+}
+
+void UserList::loadFile(const string &filename) {
+	//wait for any save in progress
+	FileLock lock(filename, false);
+	readFile(filename);
+}
+
+void UserList::readFile(const string &filename) {
+	string buf;
+	if (!readFileImage(filename, buf)) {
+		throw FileException("No users found.");
+	}
+
+	users.clear();
+	if (buf.size() >= sizeof(USER_FILE_MAGIC)
+			&& memcmp(buf.data(), USER_FILE_MAGIC, sizeof(USER_FILE_MAGIC))
+					== 0) {
+		loadImage(buf);
+	} else {
+		loadLegacy(buf);
+	}
+}
+
+void UserList::loadImage(const string &buf) {
+	if (buf.size() < USER_FILE_HEADER_SIZE) {
+		throw FileException("Corrupted users file: truncated header.");
+	}
+
+	uint32_t version, recordCount, checksum;
+	memcpy(&version, buf.data() + 4, sizeof(version));
+	memcpy(&recordCount, buf.data() + 8, sizeof(recordCount));
+	memcpy(&checksum, buf.data() + 12, sizeof(checksum));
+	if (version != USER_FILE_VERSION && version != 2) {
+		throw FileException("Unsupported users file version.");
+	}
+	//version 2 files have no checksum, so every offset and length is
+	//checked against the buffer
+	if (version == USER_FILE_VERSION
+			&& crc32c(buf.data() + USER_FILE_HEADER_SIZE,
+					buf.size() - USER_FILE_HEADER_SIZE) != checksum) {
+		throw FileException("Corrupted users file: checksum mismatch.");
+	}
+
+	size_t tableEnd = USER_FILE_HEADER_SIZE
+			+ (size_t) recordCount * sizeof(uint32_t);
+	if (tableEnd > buf.size()) {
+		throw FileException("Corrupted users file: truncated offsets table.");
+	}
+
+	users.resize(recordCount);
+	for (uint32_t i = 0; i < recordCount; i++) {
+		uint32_t offset;
+		memcpy(&offset,
+				buf.data() + USER_FILE_HEADER_SIZE + i * sizeof(uint32_t),
+				sizeof(offset));
+
+		if (offset < tableEnd || offset > buf.size()
+				|| users[i].readFrom(buf.data() + offset, buf.size() - offset)
+						== 0) {
+			users.clear();
+			throw FileException("Corrupted users file: bad record.");
+		}
+	}
+}
+
+void UserList::loadLegacy(const string &buf) {
+	size_t pos = 0;
+	while (pos < buf.size()) {
+		User u;
+		size_t used = u.readLegacy(buf.data() + pos, buf.size() - pos);
+		if (used == 0) {
+			users.clear();
+			throw FileException("Corrupted users file: bad record.");
+		}
+		users.push_back(std::move(u));
+		pos += used;
+	}
+}
+
+void UserList::saveFile(const string &filename) const {
+	FileLock lock(filename, true);
+
+	//keep users that other sessions signed up since we loaded
+	vector<User> users = this->users;
+	unordered_set<string> known;
+	for (const User &u : users) {
+		known.insert(u.getUsername());
+	}
+	//a file that is there but cannot be read stops the save, so it is not
+	//replaced by the users this session knows about
+	UserList onDisk;
+	struct stat st;
+	if (stat(filename.c_str(), &st) == 0 || errno != ENOENT) {
+		onDisk.readFile(filename);
+	}
+	for (const User &u : onDisk.users) {
+		if (known.insert(u.getUsername()).second) {
+			users.push_back(u);
+		}
+	}
+
+	//build header, offsets table and records in one buffer
+	uint32_t recordCount = users.size();
+	string buf(USER_FILE_HEADER_SIZE + recordCount * sizeof(uint32_t), '\0');
+	memcpy(&buf[0], USER_FILE_MAGIC, sizeof(USER_FILE_MAGIC));
+	memcpy(&buf[4], &USER_FILE_VERSION, sizeof(USER_FILE_VERSION));
+	memcpy(&buf[8], &recordCount, sizeof(recordCount));
+
+	for (uint32_t i = 0; i < recordCount; i++) {
+		uint32_t offset = buf.size();
+		memcpy(&buf[USER_FILE_HEADER_SIZE + i * sizeof(uint32_t)], &offset,
+				sizeof(offset));
+		users[i].writeTo(buf);
+	}
+	uint32_t checksum = crc32c(buf.data() + USER_FILE_HEADER_SIZE,
+			buf.size() - USER_FILE_HEADER_SIZE);
+	memcpy(&buf[12], &checksum, sizeof(checksum));
+
+	replaceFile(filename, buf);
+}
+
+MemoryUsage UserList::memoryUsage(const string &name) const {
+	MemoryUsage usage(name, users.size(), users.capacity() * sizeof(User));
+	for (const User &u : users) {
+		usage.bytes += u.heapBytes();
+	}
+	return usage;
+}
+
+BudgetBook::BudgetBook() {
+}
+
+void BudgetBook::loadFile(const string &filename) {
+	FileLock lock(filename, false);
+	budgets.clear();
+	changedUsers.clear();
+	readFile(filename, false);
+}
+
+void BudgetBook::readFile(const string &filename, bool keepChanged) {
+	string buf;
+	if (!readFileImage(filename, buf)) {
+		//no budgets yet
+		return;
+	}
+
+	uint32_t version, recordCount;
+	if (buf.size() < BUDGET_FILE_HEADER_SIZE
+			|| memcmp(buf.data(), BUDGET_FILE_MAGIC, sizeof(BUDGET_FILE_MAGIC))
+					!= 0) {
+		throw FileException("Corrupted budgets file: bad header.");
+	}
+	uint32_t checksum;
+	memcpy(&version, buf.data() + 4, sizeof(version));
+	memcpy(&recordCount, buf.data() + 8, sizeof(recordCount));
+	memcpy(&checksum, buf.data() + 12, sizeof(checksum));
+	if (version != BUDGET_FILE_VERSION && version != 1) {
+		throw FileException("Unsupported budgets file version.");
+	}
+	//version 1 files have no checksum; the records are still bounds-checked
+	if (version == BUDGET_FILE_VERSION
+			&& crc32c(buf.data() + BUDGET_FILE_HEADER_SIZE,
+					buf.size() - BUDGET_FILE_HEADER_SIZE) != checksum) {
+		throw FileException("Corrupted budgets file: checksum mismatch.");
+	}
+
+	map<string, map<int, double>> found;
+	size_t pos = BUDGET_FILE_HEADER_SIZE;
+	for (uint32_t i = 0; i < recordCount; i++) {
+		uint16_t ulen;
+		double limit;
+		if (buf.size() - pos < BUDGET_RECORD_FIXED_SIZE) {
+			throw FileException("Corrupted budgets file: bad record.");
+		}
+		memcpy(&ulen, buf.data() + pos, sizeof(ulen));
+		int category = (uint8_t) buf[pos + 2];
+		memcpy(&limit, buf.data() + pos + 3, sizeof(limit));
+		pos += BUDGET_RECORD_FIXED_SIZE;
+		if (buf.size() - pos < ulen || category >= TRANSACTION_CATEGORY_COUNT) {
+			throw FileException("Corrupted budgets file: bad record.");
+		}
+		found[string(buf.data() + pos, ulen)][category] = limit;
+		pos += ulen;
+	}
+
+	for (auto &entry : found) {
+		if (!keepChanged || changedUsers.count(entry.first) == 0) {
+			budgets[entry.first] = std::move(entry.second);
+		}
+	}
+}
+
+void BudgetBook::saveFile(const string &filename) {
+	FileLock lock(filename, true);
+
+	//pick up budgets other sessions saved for users we did not touch
+	readFile(filename, true);
+
+	uint32_t recordCount = 0;
+	string buf(BUDGET_FILE_HEADER_SIZE, '\0');
+	for (const auto &user : budgets) {
+		for (const auto &budget : user.second) {
+			uint16_t ulen = user.first.size();
+			uint8_t category = budget.first;
+			buf.append(reinterpret_cast<const char*>(&ulen), sizeof(ulen));
+			buf.append(reinterpret_cast<const char*>(&category),
+					sizeof(category));
+			buf.append(reinterpret_cast<const char*>(&budget.second),
+					sizeof(budget.second));
+			buf.append(user.first, 0, ulen);
+			recordCount++;
+		}
+	}
+	memcpy(&buf[0], BUDGET_FILE_MAGIC, sizeof(BUDGET_FILE_MAGIC));
+	memcpy(&buf[4], &BUDGET_FILE_VERSION, sizeof(BUDGET_FILE_VERSION));
+	memcpy(&buf[8], &recordCount, sizeof(recordCount));
+	uint32_t checksum = crc32c(buf.data() + BUDGET_FILE_HEADER_SIZE,
+			buf.size() - BUDGET_FILE_HEADER_SIZE);
+	memcpy(&buf[12], &checksum, sizeof(checksum));
+
+	replaceFile(filename, buf);
+}
+
+void BudgetBook::getLimits(const string &username,
+		double limits[TRANSACTION_CATEGORY_COUNT]) const {
+	for (int i = 0; i < TRANSACTION_CATEGORY_COUNT; i++) {
+		limits[i] = 0;
+	}
+	auto it = budgets.find(username);
+	if (it != budgets.end()) {
+		for (const auto &budget : it->second) {
+			limits[budget.first] = budget.second;
+		}
+	}
+}
+
+void BudgetBook::setLimit(const string &username,
+		TransactionCategory category, double limit) {
+	map<int, double> &limits = budgets[username];
+	if (limit > 0) {
+		limits[category] = limit;
+	} else {
+		limits.erase(category);
+	}
+	changedUsers.insert(username);
+}
+
+App::App() {
+	saver.start(AUTOSAVE_INTERVAL_MS, AUTOSAVE_DIRTY_ROWS);
+	transList.setSaveWorker(&saver);
+}
+
+//sign in
+void App::signIn() {
+	string temp;
+	string username, password;
+
+	cout << "Enter username: ";
+	cin >> username;
+	cout << "Enter password: ";
+	cin >> password;
+	getline(cin, temp); //skip '\n'
+
+	bool admin;
+	if (userList.login(username, password, admin)) {
+		currentUser = username;
+		transList.setCurrentUser(currentUser);
+
+		double limits[TRANSACTION_CATEGORY_COUNT];
+		budgets.getLimits(currentUser, limits);
+		transList.setBudgetLimits(limits);
+
+		if (admin) {
+			runAdminMenu();
+		} else {
+			runUserMenu();
+		}
+	} else {
+		cout << "Sign in failed." << endl;
+	}
+}
+
+//sign up
+void App::signUp() {
+	string temp;
+	string username, password;
+	bool admin;
+
+	cout << "Enter username: ";
+	cin >> username;
+	cout << "Enter password: ";
+	cin >> password;
+	cout << "Admin?(y/n): ";
+	cin >> temp;
+	std::transform(temp.begin(), temp.end(), temp.begin(), ::tolower); //convert temp to lowercase
+	admin = temp == "y";
+	getline(cin, temp); //skip '\n'
+
+	if (!userList.hasUser(username)) {
+		userList.addUser(username, password, admin);
+	} else {
+		cout << "The username already exists." << endl;
+	}
+}
+
+void App::runMenu() {
+	try {
+		userList.loadFile(USER_FILENAME);
+	} catch (const exception &e) {
+		cout << "Exception: " << e.what() << endl;
+	}
+	try {
+		budgets.loadFile(BUDGET_FILENAME);
+	} catch (const exception &e) {
+		cout << "Exception: " << e.what() << endl;
+	}
+
+	//Repeatedly show the menu until the user exits
+	bool quit = false;
+	while (!quit) {
+		//show the menu
+		cout << endl;
+		cout << "1. Sign in" << endl;
+		cout << "2. Sing up" << endl;
+		cout << "0. exit" << endl;
+
+		//Accept user input
+		string option;
+		getline(cin, option);
+
+		//Implement command handling via functions
+		if (option == "1") {
+			signIn();
+		} else if (option == "2") {
+			signUp();
+		} else if (option == "0") {
+			//user exits
+			quit = true;
+		}
+	}
+
+	try {
+		userList.saveFile(USER_FILENAME);
+		budgets.saveFile(BUDGET_FILENAME);
+	} catch (const exception &e) {
+		cout << "Exception: " << e.what() << endl;
+	}
+}
+
+//show normal user menu.
+void App::runUserMenu() {
+	//rows are loaded on first display, search or sort
+	transList.attachFile(TRANS_FILENAME);
+
+	//Repeatedly show the menu until the user exits
+	bool quit = false;
+	while (!quit) {
+		//show the menu
+		cout << endl;
+		cout << "1. add transaction" << endl;
+		cout << "2. modify transaction" << endl;
+		cout << "3. search transactions" << endl;
+		cout << "4. sort transactions" << endl;
+		cout << "5. display transactions" << endl;
+		cout << "6. recent transactions" << endl;
+		cout << "7. largest expenses" << endl;
+		cout << "8. set budget" << endl;
+		cout << "9. export transactions" << endl;
+		cout << "10. import statement" << endl;
+		cout << "11. undo" << endl;
+		cout << "12. redo" << endl;
+		cout << "0. exit" << endl;
+
+		//Accept user input
+		string option;
+		getline(cin, option);
+
+		//Implement command handling via functions
+		//a load that fails leaves the rows unloaded; report it and go on
+		try {
+			if (option == "1") {
+				addTransaction();
+			} else if (option == "2") {
+				modifyTransaction();
+			} else if (option == "3") {
+				searchTransaction();
+			} else if (option == "4") {
+				sortTransactions();
+			} else if (option == "5") {
+				displayTransactions();
+			} else if (option == "6") {
+				recentTransactions();
+			} else if (option == "7") {
+				largestExpenses();
+			} else if (option == "8") {
+				setBudget();
+			} else if (option == "9") {
+				exportTransactions(false);
+			} else if (option == "10") {
+				importStatement();
+			} else if (option == "11") {
+				undo();
+			} else if (option == "12") {
+				redo();
+			} else if (option == "0") {
+				//user exits
+				quit = true;
+			}
+		} catch (const exception &e) {
+			cout << "Exception: " << e.what() << endl;
+		}
+		showAlerts();
+	}
+
+	try {
+		transList.saveFile(TRANS_FILENAME);
+	} catch (const exception &e) {
+		cout << "Exception: " << e.what() << endl;
+	}
+}
+
+//show normal user menu.
+void App::runAdminMenu() {
+	//rows are loaded on first display, search or sort
+	transList.attachFile(TRANS_FILENAME);
+
+	//Repeatedly show the menu until the user exits
+	bool quit = false;
+	while (!quit) {
+		//show the menu
+		cout << endl;
+		cout << "1. add transaction" << endl;
+		cout << "2. modify transaction" << endl;
+		cout << "3. delete transaction" << endl;
+		cout << "4. search transactions" << endl;
+		cout << "5. sort transactions" << endl;
+		cout << "6. display transactions" << endl;
+		cout << "7. recent transactions" << endl;
+		cout << "8. largest expenses" << endl;
+		cout << "9. set budget" << endl;
+		cout << "10. export transactions" << endl;
+		cout << "11. import statement" << endl;
+		cout << "12. undo" << endl;
+		cout << "13. redo" << endl;
+		cout << "14. ledger report" << endl;
+		cout << "15. memory usage" << endl;
+		cout << "0. exit" << endl;
+
+		//Accept user input
+		string option;
+		getline(cin, option);
+
+		//Implement command handling via functions
+		//a load that fails leaves the rows unloaded; report it and go on
+		try {
+			if (option == "1") {
+				addTransaction();
+			} else if (option == "2") {
+				modifyTransaction();
+			} else if (option == "3") {
+				deleteTransaction();
+			} else if (option == "4") {
+				searchTransaction();
+			} else if (option == "5") {
+				sortTransactions();
+			} else if (option == "6") {
+				displayTransactions();
+			} else if (option == "7") {
+				recentTransactions();
+			} else if (option == "8") {
+				largestExpenses();
+			} else if (option == "9") {
+				setBudget();
+			} else if (option == "10") {
+				exportTransactions(true);
+			} else if (option == "11") {
+				importStatement();
+			} else if (option == "12") {
+				undo();
+			} else if (option == "13") {
+				redo();
+			} else if (option == "14") {
+				ledgerReport();
+			} else if (option == "15") {
+				memoryReport();
+			} else if (option == "0") {
+				//user exits
+				quit = true;
+			}
+		} catch (const exception &e) {
+			cout << "Exception: " << e.what() << endl;
+		}
+		showAlerts();
+	}
+
+	try {
+		transList.saveFile(TRANS_FILENAME);
+	} catch (const exception &e) {
+		cout << "Exception: " << e.what() << endl;
+	}
+}
+
+//prompt user to create a transaction.
+Transaction App::createTransaction() {
+	string temp;
+
+	int type;
+	string date; // format: "DD/MM/YYYY"
+	int category; //Housing, Transportation, Food
+	string description;
+	double amount; //positive or negative float value
+
+	//enter type
+	cout << "Enter type(1-Income, 2-Expense): ";
+	getline(cin, temp);
+	type = atoi(temp.c_str());
+	while (!(type >= 1 && type <= 2)) {
+		cout << "Enter type(1-Income, 2-Expense): ";
+		getline(cin, temp);
+		type = atoi(temp.c_str());
+	}
+	type--; //type is 0 or 1
+
+	//enter date
+	cout << "Enter date(DD/MM/YYYY): ";
+	getline(cin, date);
+	while (!validateDate(date)) {
+		cout << "Enter date(DD/MM/YYYY): ";
+		getline(cin, date);
+	}
+
+	//enter category
+	if (type == 0) {
+		//Income
+		cout << "Enter category(1-Salary, 2-Cash, 3-Gift): ";
+		getline(cin, temp);
+		category = atoi(temp.c_str());
+		while (!(category >= 1 && category <= 3)) {
+			cout << "Enter category(1-Salary, 2-Cash, 3-Gift): ";
+			getline(cin, temp);
+			category = atoi(temp.c_str());
+		}
+		category--; //category is 0-2
+	} else {
+		//Exponse
+		cout
+				<< "Enter category(1-Food, 2-Clothes, 3-Transportation, 4-Entertainment, 5-Communication, 6-Other): ";
+		getline(cin, temp);
+		category = atoi(temp.c_str());
+		while (!(category >= 1 && category <= 6)) {
+			cout
+					<< "Enter category(1-Food, 2-Clothes, 3-Transportation, 4-Entertainment, 5-Communication, 6-Other): ";
+			getline(cin, temp);
+			category = atoi(temp.c_str());
+		}
+		category += 2; //category is 3-8
+	}
+
+	//enter description; a trailing '?' lists past ones to pick from
+	cout << "Enter description(end with ? for suggestions): ";
+	getline(cin, description);
+	while (!description.empty() && description.back() == '?') {
+		description.pop_back();
+		vector<string> suggestions = transList.completeDescription(
+				description, SUGGESTION_COUNT);
+		if (suggestions.empty()) {
+			cout << "no suggestions." << endl;
+		}
+		for (size_t i = 0; i < suggestions.size(); i++) {
+			cout << (i + 1) << ". " << suggestions[i] << endl;
+		}
+		cout << "Enter description(number to pick, end with ? for suggestions): ";
+		getline(cin, temp);
+		size_t pick = atoi(temp.c_str());
+		if (pick >= 1 && pick <= suggestions.size()
+				&& temp == std::to_string(pick)) {
+			description = suggestions[pick - 1];
+		} else {
+			description = temp;
+		}
+	}
+
+	//enter amount
+	cout << "Enter amount: ";
+	getline(cin, temp);
+	while (!validateAmount(temp)) {
+		cout << "Enter amount: ";
+		getline(cin, temp);
+	}
+	amount = atof(temp.c_str());
+
+	//create object
+	return Transaction(currentUser, (TransactionType) type, std::move(date),
+			(TransactionCategory) category, std::move(description), amount);
+}
+
+void App::addTransaction() {
+	//create object and add to array
+	transList.addTransaction(createTransaction());
+}
+
+void App::modifyTransaction() {
+	transList.materialize();
+	if (transList.size() == 0) {
+		cout << "no transactions now." << endl;
+		return;
+	}
+
+	int index = transList.selectTransaction();
+
+	//create object and update transaction at index in array
+	transList.modifyTransaction(index, createTransaction());
+}
+
+void App::deleteTransaction() {
+	transList.materialize();
+	if (transList.size() == 0) {
+		cout << "no transactions now." << endl;
+		return;
+	}
+
+	int index = transList.selectTransaction();
+	transList.deleteTransaction(index);
+}
+
+void App::searchTransaction() {
+	string keyword;
+
+	cout << "Enter keyword: ";
+	getline(cin, keyword);
+	ExportFilter filter;
+	filter.username = currentUser;
+	filter.fromDate = promptOptionalDate("Enter first date(DD/MM/YYYY, empty for any): ");
+	filter.toDate = promptOptionalDate("Enter last date(DD/MM/YYYY, empty for any): ");
+
+	Queue queue;
+	if (filter.fromDate || filter.toDate) {
+		//a date range reads only the segments of its years, so unsaved
+		//changes must reach them first
+		saver.flush();
+		searchTransactionFile(TRANS_FILENAME, filter, keyword, queue);
+	} else {
+		transList.searchTransaction(keyword, queue);
+	}
+	printTableHeader();
+	queue.print();
+}
+
+int App::promptCount() {
+	string temp;
+	int count;
+
+	cout << "How many: ";
+	getline(cin, temp);
+	count = atoi(temp.c_str());
+	while (count < 1) {
+		cout << "How many: ";
+		getline(cin, temp);
+		count = atoi(temp.c_str());
+	}
+	return count;
+}
+
+void App::recentTransactions() {
+	int count = promptCount();
+
+	printTableHeader();
+	Queue queue;
+	transList.topTransactions(LatestFirst, count, queue);
+	queue.print();
+}
+
+void App::largestExpenses() {
+	int count = promptCount();
+
+	printTableHeader();
+	Queue queue;
+	transList.topTransactions(LargestExpenseFirst, count, queue);
+	queue.print();
+}
+
+void App::setBudget() {
+	string temp;
+	int category;
+
+	cout << "Enter category(1-Food, 2-Clothes, 3-Transportation, 4-Entertainment, 5-Communication, 6-Other): ";
+	getline(cin, temp);
+	category = atoi(temp.c_str());
+	while (!(category >= 1 && category <= 6)) {
+		cout << "Enter category(1-Food, 2-Clothes, 3-Transportation, 4-Entertainment, 5-Communication, 6-Other): ";
+		getline(cin, temp);
+		category = atoi(temp.c_str());
+	}
+	category += 2; //category is 3-8
+
+	cout << "Enter monthly budget(0 to remove): ";
+	getline(cin, temp);
+	while (!validateAmount(temp)) {
+		cout << "Enter monthly budget(0 to remove): ";
+		getline(cin, temp);
+	}
+	double limit = atof(temp.c_str());
+
+	//the tracker needs the rows loaded and may throw; the saved budgets
+	//change only once it has the new limit
+	transList.setBudget((TransactionCategory) category, limit);
+	budgets.setLimit(currentUser, (TransactionCategory) category, limit);
+}
+
+uint32_t App::promptOptionalDate(const string &prompt) {
+	string date;
+
+	cout << prompt;
+	getline(cin, date);
+	while (!date.empty() && !validateDate(date)) {
+		cout << prompt;
+		getline(cin, date);
+	}
+	if (date.empty()) {
+		return 0;
+	}
+	return Transaction("", Income, date, Other, "", 0).getDateKey();
+}
+
+void App::exportTransactions(bool admin) {
+	string temp;
+	int format;
+
+	cout << "Enter format(1-CSV, 2-JSON Lines): ";
+	getline(cin, temp);
+	format = atoi(temp.c_str());
+	while (!(format >= 1 && format <= 2)) {
+		cout << "Enter format(1-CSV, 2-JSON Lines): ";
+		getline(cin, temp);
+		format = atoi(temp.c_str());
+	}
+
+	ExportFilter filter;
+	filter.username = currentUser;
+	if (admin) {
+		cout << "Enter username(empty for all users): ";
+		getline(cin, filter.username);
+	}
+	filter.fromDate = promptOptionalDate("Enter first date(DD/MM/YYYY, empty for any): ");
+	filter.toDate = promptOptionalDate("Enter last date(DD/MM/YYYY, empty for any): ");
+
+	string output;
+	cout << "Enter output file(empty for screen): ";
+	getline(cin, output);
+
+	int fd = STDOUT_FILENO;
+	if (!output.empty()) {
+		fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			cout << "Failed to create file " << output << "." << endl;
+			return;
+		}
+	}
+
+	try {
+		//export reads the file, so unsaved changes must reach it first
+		saver.flush();
+		cout.flush();
+		size_t rows = ::exportTransactions(TRANS_FILENAME, filter,
+				format == 1 ? ExportCsv : ExportJsonLines, fd);
+		cout << "exported " << rows << " transactions." << endl;
+	} catch (const exception &e) {
+		cout << "Exception: " << e.what() << endl;
+	}
+
+	if (fd != STDOUT_FILENO) {
+		close(fd);
+	}
+}
+
+void App::importStatement() {
+	string filename;
+
+	cout << "Enter statement file(CSV): ";
+	getline(cin, filename);
+
+	vector<Transaction> rows;
+	StatementImporter importer;
+	ImportResult result;
+	try {
+		result = importer.readFile(filename, currentUser, rows);
+		result.imported = transList.importTransactions(std::move(rows));
+	} catch (const exception &e) {
+		cout << "Exception: " << e.what() << endl;
+		return;
+	}
+
+	cout << "imported " << result.imported << " transactions ("
+			<< result.parsed - result.imported << " duplicates, "
+			<< result.invalid << " invalid lines)." << endl;
+}
+
+void App::ledgerReport() {
+	string temp;
+	int fields = 0;
+
+	while (fields == 0) {
+		cout << "Group by(u-user, c-category, m-month, e.g. uc): ";
+		getline(cin, temp);
+		for (char c : temp) {
+			c = tolower(c);
+			fields |= c == 'u' ? GroupByUser : c == 'c' ? GroupByCategory :
+						c == 'm' ? GroupByMonth : 0;
+		}
+	}
+
+	ExportFilter filter;
+	filter.fromDate = promptOptionalDate("Enter first date(DD/MM/YYYY, empty for any): ");
+	filter.toDate = promptOptionalDate("Enter last date(DD/MM/YYYY, empty for any): ");
+
+	vector<GroupTotal> groups;
+	if (filter.fromDate || filter.toDate) {
+		//as in searchTransaction, only the segments of the range are read
+		saver.flush();
+		groupTransactionFile(TRANS_FILENAME, filter, fields, groups);
+	} else {
+		transList.groupTotals(fields, groups);
+	}
+
+	cout.setf(ios::left);
+	cout.setf(ios::fixed);
+	cout << setw(15) << "User" << setw(10) << "Month" << setw(20) << "Category"
+			<< setw(10) << "Count" << setw(15) << "Income" << setw(15)
+			<< "Expense" << "Average" << endl;
+	for (const GroupTotal &group : groups) {
+		ostringstream month;
+		if (group.month) {
+			month << setfill('0') << setw(2) << group.month % 100 << '/'
+					<< group.month / 100;
+		}
+		cout << setw(15) << (group.username.empty() ? "-" : group.username);
+		cout << setw(10) << (group.month ? month.str() : "-");
+		cout << setw(20)
+				<< (group.category >= 0 ?
+						CATEGORY_NAMES[group.category] : "-");
+		cout << setw(10) << group.count;
+		cout << setw(15) << setprecision(2) << group.income;
+		cout << setw(15) << group.expense;
+		cout << group.average() << endl;
+	}
+	cout.unsetf(ios::left);
+}
+
+void App::memoryReport() {
+	vector<MemoryUsage> usage;
+	size_t rows = transList.memoryUsage(usage);
+	usage.push_back(userList.memoryUsage("users"));
+
+	//search results live in arenas only while a command runs
+	const AllocationCounters &queues = ArenaPolicy::counters();
+	usage.emplace_back("search queues",
+			queues.allocations - queues.releases, queues.heldBytes);
+
+	printMemoryUsage(usage, rows);
+
+	HeapPolicy::counters().print("heap nodes");
+	PoolPolicy::counters().print("pooled nodes");
+	ArenaPolicy::counters().print("arena nodes");
+}
+
+void App::undo() {
+	if (!transList.undo()) {
+		cout << "nothing to undo." << endl;
+	}
+}
+
+void App::redo() {
+	if (!transList.redo()) {
+		cout << "nothing to redo." << endl;
+	}
+}
+
+void App::showAlerts() {
+	for (const string &alert : transList.takeAlerts()) {
+		cout << alert << endl;
+	}
+}
+
+void App::displayTransactions() {
+	printTableHeader();
+	transList.displayTransactions();
+}
+
+void App::sortTransactions() {
+	string temp;
+
+	cout << "Sort by(d-date, c-category, t-type, a-amount, each optionally "
+			"followed by + or -, e.g. dca-; blank for latest first): ";
+	getline(cin, temp);
+
+	//dates and amounts default to largest first, the others to menu order
+	vector<SortColumn> columns;
+	int used = 0;
+	for (char c : temp) {
+		int field = string("dcta").find(tolower(c));
+		if (field != (int) string::npos && !(used & 1 << field)) {
+			used |= 1 << field;
+			columns.push_back( { (SortField) field, field == SortByDate
+					|| field == SortByAmount });
+		} else if ((c == '+' || c == '-') && !columns.empty()) {
+			columns.back().descending = c == '-';
+		}
+	}
+
+	if (columns.empty()) {
+		transList.sortTransactions();
+	} else {
+		transList.sortTransactions(columns);
+	}
+	displayTransactions();
+}
+
+void App::printTableHeader() const {
+	cout.setf(ios::left);
+	cout.setf(ios::fixed);
+	cout << "    ";
+	cout << setw(10) << "Type";
+	cout << setw(15) << "Date";
+	cout << setw(20) << "Category";
+	cout << setw(15) << "Amount";
+	cout << "Description";
+	cout << endl;
+
+	cout.unsetf(ios::left);
+}
+
+//validate date (DD/MM/YYYY)
+bool App::validateDate(const string &input) {
+	if (input.size() != 10) {
+		return false;
+	}
+
+	if (input[2] != '/' || input[5] != '/') {
+		return false;
+	}
+
+	string dd = input.substr(0, 2);
+	string mm = input.substr(3, 2);
+	string yyyy = input.substr(6, 4);
+
+	int d = atoi(dd.c_str());
+	int m = atoi(mm.c_str());
+	int y = atoi(yyyy.c_str());
+
+	return d >= 1 && d <= 31 && m >= 1 && m <= 12 && y >= 2000;
+}
+
+//validate amount (a number)
+bool App::validateAmount(const string &input) {
+	double amount;
+	return parseAmount(input, amount) && amount >= 0;
+}
+
+User::User() :
+		admin(false) {
+
+}
+
+void User::writeTo(string &buf) const {
+	uint16_t ulen = username.size();
+	uint16_t plen = passwordEncrypted.size();
+	uint8_t flag = admin ? 1 : 0;
+	buf.append(reinterpret_cast<const char*>(&ulen), sizeof(ulen));
+	buf.append(reinterpret_cast<const char*>(&plen), sizeof(plen));
+	buf.append(reinterpret_cast<const char*>(&flag), sizeof(flag));
+	buf.append(username, 0, ulen);
+	buf.append(passwordEncrypted, 0, plen);
+}
+
+size_t User::readFrom(const char *data, size_t size) {
+	uint16_t ulen, plen;
+	if (size < USER_RECORD_FIXED_SIZE) {
+		return 0;
+	}
+	memcpy(&ulen, data, sizeof(ulen));
+	memcpy(&plen, data + 2, sizeof(plen));
+	admin = data[4] != 0;
+
+	size_t total = USER_RECORD_FIXED_SIZE + ulen + plen;
+	if (size < total) {
+		return 0;
+	}
+	username.assign(data + USER_RECORD_FIXED_SIZE, ulen);
+	passwordEncrypted.assign(data + USER_RECORD_FIXED_SIZE + ulen, plen);
+	return total;
+}
+
+size_t User::readLegacy(const char *data, size_t size) {
+	size_t pos = 0;
+	string *fields[] = { &username, &passwordEncrypted };
+	for (string *field : fields) {
+		size_t len;
+		if (size - pos < sizeof(len)) {
+			return 0;
+		}
+		memcpy(&len, data + pos, sizeof(len));
+		pos += sizeof(len);
+		if (size - pos < len) {
+			return 0;
+		}
+		field->assign(data + pos, len);
+		pos += len;
+	}
+
+	//admin flag, stored with its own length prefix
+	size_t alen;
+	if (size - pos < sizeof(alen)) {
+		return 0;
+	}
+	memcpy(&alen, data + pos, sizeof(alen));
+	pos += sizeof(alen);
+	if (alen != 1 || size - pos < alen) {
+		return 0;
+	}
+	admin = data[pos] != 0;
+	return pos + alen;
+}
+
+string User::hash(const string &password) {
+	unsigned char hash[SHA256_DIGEST_LENGTH];
+	SHA256((unsigned char*) password.c_str(), password.size(), hash);
+	std::stringstream ss;
+	for (unsigned char i : hash) {
+		ss << std::hex << std::setw(2) << std::setfill('0') << (int) i;
+	}
+	return ss.str();
+}
+
+User::User(const string &username, const string &password, bool admin) :
+		username(username), passwordEncrypted(hash(password)), admin(admin) {
+}
+
+bool User::isAdmin() const {
+	return admin;
+}
+
+const string& User::getPassword() const {
+	return passwordEncrypted;
+}
+
+const string& User::getUsername() const {
+	return username;
+}
+
+size_t User::heapBytes() const {
+	return ::heapBytes(username) + ::heapBytes(passwordEncrypted);
+}
+
+void MessageWriter::putU8(uint8_t value) {
+	buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void MessageWriter::putU32(uint32_t value) {
+	buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void MessageWriter::putDouble(double value) {
+	buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void MessageWriter::putString(const string &value) {
+	uint16_t len = value.size() > 0xffff ? 0xffff : value.size();
+	buf.append(reinterpret_cast<const char*>(&len), sizeof(len));
+	buf.append(value, 0, len);
+}
+
+void MessageWriter::putTransaction(const Transaction &trans) {
+	putU8(trans.getTypeInt());
+	putString(trans.getDate());
+	putU8(trans.getCategoryInt());
+	putString(trans.getDescription());
+	putDouble(trans.getAmount());
+}
+
+const string& MessageWriter::data() const {
+	return buf;
+}
+
+string MessageWriter::frame(uint8_t code) const {
+	uint32_t len = buf.size() + 1;
+	string out(reinterpret_cast<const char*>(&len), sizeof(len));
+	out += (char) code;
+	out += buf;
+	return out;
+}
+
+MessageReader::MessageReader(const char *data, size_t size) :
+		data(data), size(size), pos(0), valid(true) {
+}
+
+bool MessageReader::take(void *out, size_t len) {
+	if (!valid || size - pos < len) {
+		valid = false;
+		return false;
+	}
+	memcpy(out, data + pos, len);
+	pos += len;
+	return true;
+}
+
+uint8_t MessageReader::getU8() {
+	uint8_t value = 0;
+	take(&value, sizeof(value));
+	return value;
+}
+
+uint32_t MessageReader::getU32() {
+	uint32_t value = 0;
+	take(&value, sizeof(value));
+	return value;
+}
+
+double MessageReader::getDouble() {
+	double value = 0;
+	take(&value, sizeof(value));
+	return value;
+}
+
+string MessageReader::getString() {
+	uint16_t len = 0;
+	if (!take(&len, sizeof(len)) || size - pos < len) {
+		valid = false;
+		return "";
+	}
+	string value(data + pos, len);
+	pos += len;
+	return value;
+}
+
+bool MessageReader::ok() const {
+	return valid;
+}
+
+bool MessageReader::done() const {
+	return valid && pos == size;
+}
+
+WorkerPool::WorkerPool(int threadCount) :
+		stopping(false) {
+	for (int i = 0; i < threadCount; i++) {
+		threads.emplace_back(&WorkerPool::run, this);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	ready.notify_all();
+	for (std::thread &t : threads) {
+		t.join();
+	}
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		tasks.push_back(std::move(task));
+	}
+	ready.notify_one();
+}
+
+void WorkerPool::run() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			ready.wait(lock, [this] {
+				return stopping || !tasks.empty();
+			});
+			if (tasks.empty()) {
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+//eventfd of the running server, written by the signal handler
+static int serverWakeFd = -1;
+static volatile sig_atomic_t serverStopping = 0;
+
+static void stopServer(int) {
+	serverStopping = 1;
+	uint64_t one = 1;
+	if (write(serverWakeFd, &one, sizeof(one)) < 0) {
+		//nothing else is safe to do in a signal handler
+	}
+}
+
+LedgerServer::LedgerServer(const string &socketPath, const string &transFile,
+		const string &userFile) :
+		socketPath(socketPath), transFile(transFile), epollFd(-1), listenFd(
+				-1), wakeFd(-1), pool(SERVER_WORKERS) {
+	//a missing file means no transactions yet; any other failure stops the
+	//server before a save could replace the rows it failed to read
+	struct stat st;
+	if (stat(transFile.c_str(), &st) == 0 || errno != ENOENT) {
+		ledger.loadFile(transFile);
+	}
+	users.loadFile(userFile);
+	saver.start(AUTOSAVE_INTERVAL_MS, AUTOSAVE_DIRTY_ROWS);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd < 0) {
+		throw FileException("Failed to create server socket.");
+	}
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(addr.sun_path)) {
+		throw FileException("Socket path too long: " + socketPath + ".");
+	}
+	strcpy(addr.sun_path, socketPath.c_str());
+	unlink(socketPath.c_str());
+	if (bind(listenFd, (sockaddr*) &addr, sizeof(addr)) != 0
+			|| listen(listenFd, SOMAXCONN) != 0) {
+		throw FileException("Failed to listen on " + socketPath + ".");
+	}
+
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (wakeFd < 0 || epollFd < 0) {
+		throw FileException("Failed to set up the event loop.");
+	}
+
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = listenFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+	ev.data.fd = wakeFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+}
+
+LedgerServer::~LedgerServer() {
+	for (auto &entry : connections) {
+		close(entry.first);
+	}
+	if (listenFd >= 0) {
+		close(listenFd);
+		unlink(socketPath.c_str());
+	}
+	if (epollFd >= 0) {
+		close(epollFd);
+	}
+	//wakeFd stays open: workers may still signal it until the pool joins
+}
+
+void LedgerServer::run() {
+	serverWakeFd = wakeFd;
+	serverStopping = 0;
+	signal(SIGINT, stopServer);
+	signal(SIGTERM, stopServer);
+	signal(SIGPIPE, SIG_IGN);
+
+	cout << "serving " << socketPath << endl;
+
+	epoll_event events[64];
+	while (!serverStopping) {
+		int n = epoll_wait(epollFd, events, 64, AUTOSAVE_INTERVAL_MS);
+		if (n < 0 && errno != EINTR) {
+			break;
+		}
+
+		for (int i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+			if (fd == listenFd) {
+				acceptConnections();
+			} else if (fd == wakeFd) {
+				uint64_t count;
+				if (read(wakeFd, &count, sizeof(count)) > 0) {
+					finishRequests();
+				}
+			} else {
+				auto it = connections.find(fd);
+				if (it == connections.end() || it->second.closing) {
+					continue;
+				}
+				if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+					closeConnection(fd);
+					continue;
+				}
+				if (events[i].events & EPOLLIN) {
+					readConnection(it->second);
+				}
+				it = connections.find(fd);
+				if (it != connections.end() && !it->second.closing
+						&& (events[i].events & EPOLLOUT)) {
+					writeConnection(it->second);
+				}
+			}
+		}
+
+		string error = saver.takeError();
+		if (!error.empty()) {
+			cout << "Exception: " << error << endl;
+		}
+	}
+
+	//write what is still queued
+	saver.flush();
+	string error = saver.takeError();
+	if (!error.empty()) {
+		cout << "Exception: " << error << endl;
+	}
+	cout << "server stopped." << endl;
+}
+
+void LedgerServer::changed() {
+	saver.submitRewrite(transFile, "", [this](string &out) {
+		ledger.formatRows(out);
+	});
+}
+
+void LedgerServer::acceptConnections() {
+	while (true) {
+		int fd = accept4(listenFd, nullptr, nullptr,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+
+		epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+		connections[fd] = Connection { fd, "", "", false, false, "", false };
+	}
+}
+
+void LedgerServer::readConnection(Connection &conn) {
+	char buf[65536];
+	while (true) {
+		ssize_t n = read(conn.fd, buf, sizeof(buf));
+		if (n > 0) {
+			conn.in.append(buf, n);
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else {
+			//peer closed or failed
+			closeConnection(conn.fd);
+			return;
+		}
+	}
+	dispatch(conn);
+}
+
+void LedgerServer::dispatch(Connection &conn) {
+	if (conn.busy || conn.in.size() < sizeof(uint32_t)) {
+		return;
+	}
+
+	uint32_t len;
+	memcpy(&len, conn.in.data(), sizeof(len));
+	if (len == 0 || len > MAX_FRAME_SIZE) {
+		closeConnection(conn.fd);
+		return;
+	}
+	if (conn.in.size() < sizeof(len) + len) {
+		return;
+	}
+
+	string request = conn.in.substr(sizeof(len), len);
+	conn.in.erase(0, sizeof(len) + len);
+	conn.busy = true;
+
+	int fd = conn.fd;
+	string username = conn.username;
+	bool admin = conn.admin;
+	pool.submit([this, fd, request, username, admin]() mutable {
+		string response = handle(request, username, admin);
+		{
+			std::lock_guard<std::mutex> lock(completedLock);
+			completed.push_back(Completion { fd, std::move(response),
+					username, admin });
+		}
+		uint64_t one = 1;
+		if (write(wakeFd, &one, sizeof(one)) < 0) {
+			//the loop also drains completions on its next wake-up
+		}
+	});
+}
+
+void LedgerServer::finishRequests() {
+	vector<Completion> batch;
+	{
+		std::lock_guard<std::mutex> lock(completedLock);
+		batch.swap(completed);
+	}
+
+	for (Completion &done : batch) {
+		auto it = connections.find(done.fd);
+		if (it == connections.end()) {
+			continue;
+		}
+		Connection &conn = it->second;
+		conn.busy = false;
+		if (conn.closing) {
+			//the client is gone: drop the answer and release the fd
+			closeConnection(done.fd);
+			continue;
+		}
+		conn.username = done.username;
+		conn.admin = done.admin;
+		conn.out += done.response;
+		writeConnection(conn);
+
+		//serve the next pipelined request, if any
+		it = connections.find(done.fd);
+		if (it != connections.end()) {
+			dispatch(it->second);
+		}
+	}
+}
+
+void LedgerServer::writeConnection(Connection &conn) {
+	while (!conn.out.empty()) {
+		ssize_t n = write(conn.fd, conn.out.data(), conn.out.size());
+		if (n > 0) {
+			conn.out.erase(0, n);
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else {
+			closeConnection(conn.fd);
+			return;
+		}
+	}
+
+	//only wait for writability while output is pending
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = conn.out.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT);
+	ev.data.fd = conn.fd;
+	epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+void LedgerServer::closeConnection(int fd) {
+	auto it = connections.find(fd);
+	if (it == connections.end()) {
+		return;
+	}
+	Connection &conn = it->second;
+	if (!conn.closing) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+	if (conn.busy) {
+		//a worker still answers for this session: keep the fd until then
+		conn.closing = true;
+		conn.in.clear();
+		conn.out.clear();
+		return;
+	}
+	close(fd);
+	connections.erase(it);
+}
+
+string LedgerServer::handleRow(MessageReader &reader, const string &username,
+		Transaction &trans) {
+	int type = reader.getU8();
+	string date = reader.getString();
+	int category = reader.getU8();
+	string description = reader.getString();
+	double amount = reader.getDouble();
+
+	if (!reader.done()) {
+		return "Malformed transaction.";
+	}
+	if (!(type == Income || type == Expense)) {
+		return "Invalid type.";
+	}
+	if (!(category >= Salary && category <= Other)
+			|| (type == Income) != (category <= Gift)) {
+		return "Invalid category.";
+	}
+	if (!App::validateDate(date)) {
+		return "Invalid date.";
+	}
+	if (description.find(',') != string::npos) {
+		return "Description must not contain commas.";
+	}
+	//a line break would split the row in transactions.csv
+	for (char c : description) {
+		if ((unsigned char) c < 0x20 || c == 0x7f) {
+			return "Description must not contain control characters.";
+		}
+	}
+	if (!std::isfinite(amount) || amount < 0) {
+		return "Invalid amount.";
+	}
+
+	trans = Transaction(username, (TransactionType) type, std::move(date),
+			(TransactionCategory) category, std::move(description), amount);
+	return "";
+}
+
+string LedgerServer::handle(const string &request, string &username,
+		bool &admin) {
+	MessageReader reader(request.data() + 1, request.size() - 1);
+	MessageWriter error;
+	int type = (uint8_t) request[0];
+
+	//anything a request throws becomes its error reply, so a worker thread
+	//never dies and the connection still gets its completion
+	try {
+		return handleRequest(type, reader, username, admin);
+	} catch (const char *message) {
+		error.putString(message);
+	} catch (const std::exception &e) {
+		error.putString(e.what());
+	}
+	return error.frame(StatusError);
+}
+
+string LedgerServer::handleRequest(int type, MessageReader &reader,
+		string &username, bool &admin) {
+	MessageWriter reply;
+	MessageWriter error;
+
+	if (type == RequestLogin) {
+		string name = reader.getString();
+		string password = reader.getString();
+		if (!reader.done()) {
+			error.putString("Malformed request.");
+			return error.frame(StatusBadRequest);
+		}
+		if (!users.login(name, password, admin)) {
+			error.putString("Sign in failed.");
+			return error.frame(StatusDenied);
+		}
+		username = name;
+		reply.putU8(admin ? 1 : 0);
+		return reply.frame(StatusOk);
+	}
+
+	if (username.empty()) {
+		error.putString("Not signed in.");
+		return error.frame(StatusNotSignedIn);
+	}
+
+	switch (type) {
+	case RequestAdd:
+	case RequestModify: {
+		uint32_t index = type == RequestModify ? reader.getU32() : 0;
+		Transaction trans;
+		string message = handleRow(reader, username, trans);
+		if (!message.empty()) {
+			error.putString(message);
+			return error.frame(StatusBadRequest);
+		}
+		ledger.write(username, [&](TransactionList &rows) {
+			if (type == RequestAdd) {
+				rows.addTransaction(std::move(trans));
+			} else {
+				rows.modifyTransaction(index, std::move(trans));
+			}
+		});
+		changed();
+		break;
+	}
+	case RequestDelete: {
+		uint32_t index = reader.getU32();
+		if (!reader.done()) {
+			error.putString("Malformed request.");
+			return error.frame(StatusBadRequest);
+		}
+		if (!admin) {
+			error.putString("Only admins can delete transactions.");
+			return error.frame(StatusDenied);
+		}
+		ledger.write(username, [index](TransactionList &rows) {
+			rows.deleteTransaction(index);
+		});
+		changed();
+		break;
+	}
+	case RequestSort:
+		ledger.write(username, [](TransactionList &rows) {
+			rows.sortTransactions();
+		});
+		changed();
+		break;
+	case RequestSearch:
+	case RequestList: {
+		string keyword = type == RequestSearch ? reader.getString() : "";
+		if (!reader.done()) {
+			error.putString("Malformed request.");
+			return error.frame(StatusBadRequest);
+		}
+		vector<Transaction> rows;
+		ledger.read(username, [&](const TransactionList &list) {
+			if (type == RequestList) {
+				list.appendTo(rows);
+				return;
+			}
+			Queue queue;
+			list.findTransactions(keyword, queue);
+			while (!queue.empty()) {
+				rows.push_back(queue.front());
+				queue.popFront();
+			}
+		});
+		reply.putU32(rows.size());
+		for (const Transaction &trans : rows) {
+			reply.putTransaction(trans);
+		}
+		break;
+	}
+	default:
+		error.putString("Unknown request.");
+		return error.frame(StatusBadRequest);
+	}
+
+	return reply.frame(StatusOk);
+}
+
+LedgerClient::LedgerClient() :
+		fd(-1) {
+}
+
+LedgerClient::~LedgerClient() {
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+void LedgerClient::connectTo(const string &socketPath) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(addr.sun_path)) {
+		throw FileException("Socket path too long: " + socketPath + ".");
+	}
+	strcpy(addr.sun_path, socketPath.c_str());
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+		throw FileException("Failed to connect to " + socketPath + ".");
+	}
+}
+
+ResponseStatus LedgerClient::call(RequestType type,
+		const MessageWriter &request, string &response) {
+	string frame = request.frame(type);
+	size_t sent = 0;
+	while (sent < frame.size()) {
+		ssize_t n = write(fd, frame.data() + sent, frame.size() - sent);
+		if (n <= 0) {
+			throw FileException("Lost connection to the server.");
+		}
+		sent += n;
+	}
+
+	//read the length, then the status byte and payload
+	string in;
+	uint32_t len = 0;
+	while (in.size() < sizeof(len) || in.size() < sizeof(len) + len) {
+		char buf[65536];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n <= 0) {
+			throw FileException("Lost connection to the server.");
+		}
+		in.append(buf, n);
+		if (in.size() >= sizeof(len)) {
+			memcpy(&len, in.data(), sizeof(len));
+		}
+	}
+
+	response = in.substr(sizeof(len) + 1, len - 1);
+	return (ResponseStatus) (uint8_t) in[sizeof(len)];
+}
+
+//prompt until a number in [min, max] is entered
+static int promptNumber(const string &prompt, int min, int max) {
+	string temp;
+	int value;
+	do {
+		cout << prompt;
+		if (!getline(cin, temp)) {
+			throw FileException("Input ended.");
+		}
+		value = atoi(temp.c_str());
+	} while (!(value >= min && value <= max));
+	return value;
+}
+
+//prompt for the fields of a row and add them to request
+static void promptRow(MessageWriter &request) {
+	string date, description, temp;
+
+	int type = promptNumber("Enter type(1-Income, 2-Expense): ", 1, 2) - 1;
+	cout << "Enter date(DD/MM/YYYY): ";
+	getline(cin, date);
+	while (!App::validateDate(date)) {
+		cout << "Enter date(DD/MM/YYYY): ";
+		getline(cin, date);
+	}
+	int category = type == Income ?
+			promptNumber("Enter category(1-Salary, 2-Cash, 3-Gift): ", 1, 3)
+					- 1 :
+			promptNumber("Enter category(1-Food, 2-Clothes, 3-Transportation, "
+					"4-Entertainment, 5-Communication, 6-Other): ", 1, 6) + 2;
+	cout << "Enter description: ";
+	getline(cin, description);
+	cout << "Enter amount: ";
+	getline(cin, temp);
+	while (!App::validateAmount(temp)) {
+		cout << "Enter amount: ";
+		getline(cin, temp);
 	}
 
-	try {
-		transList.saveFile(TRANS_FILENAME);
-	} catch (const exception &e) {
-		cout << "Exception: " << e.what() << endl;
+	request.putU8(type);
+	request.putString(date);
+	request.putU8(category);
+	request.putString(description);
+	request.putDouble(atof(temp.c_str()));
+}
+
+//print the rows of a Search or List response; return how many there are
+static uint32_t printRows(const string &response) {
+	MessageReader reader(response.data(), response.size());
+	uint32_t count = reader.getU32();
+	for (uint32_t i = 0; i < count; i++) {
+		int type = reader.getU8();
+		string date = reader.getString();
+		int category = reader.getU8();
+		string description = reader.getString();
+		double amount = reader.getDouble();
+		if (!reader.ok() || type >= TRANSACTION_TYPE_COUNT
+				|| category >= TRANSACTION_CATEGORY_COUNT) {
+			cout << "Malformed response." << endl;
+			return i;
+		}
+		cout.setf(ios::right);
+		cout << setw(2) << (i + 1) << ". ";
+		cout.unsetf(ios::right);
+		Transaction("", (TransactionType) type, date,
+				(TransactionCategory) category, description, amount).print();
 	}
+	return count;
 }
 
-//show normal user menu.
-void App::runAdminMenu() {
-	try {
-		transList.loadFile(TRANS_FILENAME);
-	} catch (const exception &e) {
-		cout << "Exception: " << e.what() << endl;
+void runClient(const string &socketPath) {
+	LedgerClient client;
+	client.connectTo(socketPath);
+
+	string username, password, response;
+	cout << "Enter username: ";
+	getline(cin, username);
+	cout << "Enter password: ";
+	getline(cin, password);
+	MessageWriter login;
+	login.putString(username);
+	login.putString(password);
+	if (client.call(RequestLogin, login, response) != StatusOk) {
+		cout << "Sign in failed." << endl;
+		return;
 	}
 
 	//Repeatedly show the menu until the user exits
 	bool quit = false;
 	while (!quit) {
-		//show the menu
 		cout << endl;
 		cout << "1. add transaction" << endl;
 		cout << "2. modify transaction" << endl;
@@ -998,261 +7918,634 @@ void App::runAdminMenu() {
 		cout << "6. display transactions" << endl;
 		cout << "0. exit" << endl;
 
-		//Accept user input
 		string option;
-		getline(cin, option);
+		if (!getline(cin, option)) {
+			break;
+		}
 
-		//Implement command handling via functions
+		MessageWriter request;
+		RequestType type;
 		if (option == "1") {
-			addTransaction();
-		} else if (option == "2") {
-			modifyTransaction();
-		} else if (option == "3") {
-			deleteTransaction();
+			type = RequestAdd;
+			promptRow(request);
+		} else if (option == "2" || option == "3") {
+			//rows are picked by their position in the listing
+			MessageWriter list;
+			client.call(RequestList, list, response);
+			uint32_t count = printRows(response);
+			if (count == 0) {
+				cout << "no transactions now." << endl;
+				continue;
+			}
+			request.putU32(promptNumber("Your selection: ", 1, count) - 1);
+			type = option == "2" ? RequestModify : RequestDelete;
+			if (type == RequestModify) {
+				promptRow(request);
+			}
 		} else if (option == "4") {
-			searchTransaction();
+			string keyword;
+			cout << "Enter keyword: ";
+			getline(cin, keyword);
+			request.putString(keyword);
+			type = RequestSearch;
 		} else if (option == "5") {
-			sortTransactions();
+			type = RequestSort;
 		} else if (option == "6") {
-			displayTransactions();
-		} else if (option == "0") {
-			//user exits
-			quit = true;
+			type = RequestList;
+		} else {
+			quit = option == "0";
+			continue;
 		}
-	}
 
-	try {
-		transList.saveFile(TRANS_FILENAME);
-	} catch (const exception &e) {
-		cout << "Exception: " << e.what() << endl;
+		if (client.call(type, request, response) != StatusOk) {
+			MessageReader reader(response.data(), response.size());
+			cout << reader.getString() << endl;
+		} else if (type == RequestSearch || type == RequestList
+				|| type == RequestSort) {
+			if (type == RequestSort) {
+				client.call(RequestList, MessageWriter(), response);
+			}
+			printRows(response);
+		}
 	}
 }
 
-//prompt user to create a transaction.
-Transaction App::createTransaction() {
-	string temp;
-
-	int type;
-	string date; // format: "DD/MM/YYYY"
-	int category; //Housing, Transportation, Food
-	string description;
-	double amount; //positive or negative float value
-
-	//enter type
-	cout << "Enter type(1-Income, 2-Expense): ";
-	getline(cin, temp);
-	type = atoi(temp.c_str());
-	while (!(type >= 1 && type <= 2)) {
-		cout << "Enter type(1-Income, 2-Expense): ";
-		getline(cin, temp);
-		type = atoi(temp.c_str());
+//build a synthetic ledger of the given size for benchmarks
+static vector<Transaction> makeBenchmarkRows(int rows) {
+	static const char *words[] = { "Coffee", "groceries", "Rent", "bus pass",
+			"Cinema", "phone bill", "SALARY", "gift card", "Lunch with team",
+			"Book store" };
+	std::mt19937 rng(42);
+	vector<Transaction> out;
+	out.reserve(rows);
+	for (int i = 0; i < rows; i++) {
+		char date[11];
+		snprintf(date, sizeof(date), "%02d/%02d/%04d", (int) (rng() % 28) + 1,
+				(int) (rng() % 12) + 1, 2000 + (int) (rng() % 25));
+		string description = words[rng() % 10];
+		description += " ";
+		description += words[rng() % 10];
+		int category = rng() % TRANSACTION_CATEGORY_COUNT;
+		out.push_back(Transaction("bench", category <= Gift ? Income : Expense,
+				date, (TransactionCategory) category, description,
+				(rng() % 100000) / 100.0));
 	}
-	type--; //type is 0 or 1
+	return out;
+}
 
-	//enter date
-	cout << "Enter date(DD/MM/YYYY): ";
-	getline(cin, date);
-	while (!validateDate(date)) {
-		cout << "Enter date(DD/MM/YYYY): ";
-		getline(cin, date);
-	}
+//run f once and return the elapsed time in milliseconds
+template<class F>
+static double timeMs(F f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+}
 
-	//enter category
-	if (type == 0) {
-		//Income
-		cout << "Enter category(1-Salary, 2-Cash, 3-Gift): ";
-		getline(cin, temp);
-		category = atoi(temp.c_str());
-		while (!(category >= 1 && category <= 3)) {
-			cout << "Enter category(1-Salary, 2-Cash, 3-Gift): ";
-			getline(cin, temp);
-			category = atoi(temp.c_str());
+//a new directory under $TMPDIR (or /tmp), made the working directory for
+//the object's lifetime. on the way out, also by an exception, the old
+//working directory is restored and the directory is removed with every
+//file left in it.
+class ScratchDirectory {
+	string path;
+	int previous; //the old working directory
+
+public:
+	ScratchDirectory() {
+		const char *tmp = getenv("TMPDIR");
+		string pattern = string(tmp && *tmp ? tmp : "/tmp") + "/a3bench.XXXXXX";
+		if (mkdtemp(&pattern[0]) == nullptr) {
+			throw FileException("Failed to create a directory in "
+					+ pattern.substr(0, pattern.rfind('/')) + ".");
 		}
-		category--; //category is 0-2
-	} else {
-		//Exponse
-		cout
-				<< "Enter category(1-Food, 2-Clothes, 3-Transportation, 4-Entertainment, 5-Communication, 6-Other): ";
-		getline(cin, temp);
-		category = atoi(temp.c_str());
-		while (!(category >= 1 && category <= 6)) {
-			cout
-					<< "Enter category(1-Food, 2-Clothes, 3-Transportation, 4-Entertainment, 5-Communication, 6-Other): ";
-			getline(cin, temp);
-			category = atoi(temp.c_str());
+		path = pattern;
+		previous = open(".", O_RDONLY | O_DIRECTORY);
+		if (previous < 0 || chdir(path.c_str()) != 0) {
+			if (previous >= 0) {
+				close(previous);
+			}
+			rmdir(path.c_str());
+			throw FileException("Failed to enter " + path + ".");
 		}
-		category += 2; //category is 3-8
 	}
 
-	//enter description
-	cout << "Enter description: ";
-	getline(cin, description);
-
-	//enter amount
-	cout << "Enter amount: ";
-	getline(cin, temp);
-	while (!validateAmount(temp)) {
-		cout << "Enter amount: ";
-		getline(cin, temp);
+	~ScratchDirectory() {
+		DIR *dir = opendir(".");
+		if (dir) {
+			while (dirent *entry = readdir(dir)) {
+				if (strcmp(entry->d_name, ".") != 0
+						&& strcmp(entry->d_name, "..") != 0) {
+					unlink(entry->d_name);
+				}
+			}
+			closedir(dir);
+		}
+		if (fchdir(previous) != 0) {
+			//still inside: the directory cannot be removed from here
+			close(previous);
+			return;
+		}
+		close(previous);
+		rmdir(path.c_str());
 	}
-	amount = atof(temp.c_str());
 
-	//create object
-	Transaction trans(currentUser, (TransactionType) type, date,
-			(TransactionCategory) category, description, amount);
-	return trans;
-}
+	ScratchDirectory(const ScratchDirectory&) = delete;
+	ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+};
 
-void App::addTransaction() {
-	//create object and add to array
-	Transaction trans = createTransaction();
-	transList.addTransaction(trans);
-}
+void runBenchmarks(int rows) {
+	//every file the benchmarks write, down to the key, stays in here
+	ScratchDirectory scratch;
 
-void App::modifyTransaction() {
-	if (transList.size() == 0) {
-		cout << "no transactions now." << endl;
-		return;
+	vector<Transaction> data = makeBenchmarkRows(rows);
+	cout << "benchmark rows: " << rows << endl;
+	cout.setf(ios::fixed);
+	cout << setprecision(2);
+
+	//keyword matching: lowercased copies vs in-place SIMD, on the short
+	//descriptions and on long free-text notes built from them
+	vector<string> notes;
+	for (size_t i = 0; i < data.size() / 10; i++) {
+		string note;
+		for (size_t j = 0; j < 16; j++) {
+			note += data[(i * 16 + j) % data.size()].getDescription();
+			note += ' ';
+		}
+		notes.push_back(note);
 	}
 
-	int index = transList.selectTransaction();
+	const string keyword = "team";
+	for (int pass = 0; pass < 2; pass++) {
+		vector<string> texts;
+		if (pass == 0) {
+			for (const Transaction &trans : data) {
+				texts.push_back(trans.getDescription());
+			}
+		} else {
+			texts = notes;
+		}
 
-	//create object and update transaction at index in array
-	Transaction trans = createTransaction();
-	transList.modifyTransaction(index, trans);
-}
+		size_t copyHits = 0, simdHits = 0;
+		double copyMs = timeMs([&] {
+			for (const string &text : texts) {
+				if (toLower(text).find(keyword) != string::npos) {
+					copyHits++;
+				}
+			}
+		});
+		double simdMs = timeMs([&] {
+			for (const string &text : texts) {
+				if (containsIgnoreCase(text, keyword)) {
+					simdHits++;
+				}
+			}
+		});
+		cout << (pass == 0 ? "short" : "long") << " text x" << texts.size()
+				<< ": toLower+find " << copyMs << " ms, containsIgnoreCase "
+				<< simdMs << " ms (" << copyHits << "/" << simdHits
+				<< " hits)" << endl;
+	}
 
-void App::deleteTransaction() {
-	if (transList.size() == 0) {
-		cout << "no transactions now." << endl;
-		return;
+	//column scans and sorts on a TransactionList
+	TransactionList list;
+	for (const Transaction &trans : data) {
+		list.addTransaction(trans);
+	}
+	double buildMs = timeMs([&] {
+		list.columns();
+	});
+	double total = 0;
+	double sumMs = timeMs([&] {
+		total = list.totalAmount(Expense);
+	});
+	Queue recent;
+	double topMs = timeMs([&] {
+		list.findTop(LatestFirst, 20, recent);
+	});
+	double sortMs = timeMs([&] {
+		list.sortTransactions();
+	});
+	double multiSortMs = timeMs([&] {
+		list.sortTransactions( { { SortByDate, true }, { SortByCategory, false },
+				{ SortByAmount, true } });
+	});
+	cout << "columns build " << buildMs << " ms, expense sum " << sumMs
+			<< " ms (" << total << "), latest 20 " << topMs
+			<< " ms, sort by date " << sortMs << " ms, by date, category, amount "
+			<< multiSortMs << " ms" << endl;
+
+	vector<GroupTotal> groups;
+	double groupMs = timeMs([&] {
+		list.groupTotals(GroupByUser | GroupByCategory | GroupByMonth, groups);
+	});
+	cout << "group by user, category, month " << groupMs << " ms ("
+			<< groups.size() << " groups)" << endl;
+
+	//description completions, the index having been built by the adds above
+	const char *prefixes[] = { "", "b", "gr", "Co", "rent", "x" };
+	const int completionRounds = 100000;
+	size_t suggested = 0;
+	double completeMs = timeMs([&] {
+		for (int i = 0; i < completionRounds; i++) {
+			for (const char *prefix : prefixes) {
+				suggested += list.completeDescription(prefix,
+						SUGGESTION_COUNT).size();
+			}
+		}
+	});
+	cout << "description completion "
+			<< completeMs * 1000 / (completionRounds * 6) << " us per prefix ("
+			<< suggested / completionRounds << " suggestions per round)" << endl;
+
+	//what the ledger built above holds
+	vector<MemoryUsage> usage;
+	printMemoryUsage(usage, list.memoryUsage(usage));
+
+	//node allocation: building, editing and dropping lists under each policy
+	auto allocationRun = [&](auto &list, const char *name) {
+		double fillMs = timeMs([&] {
+			for (const Transaction &trans : data) {
+				list.addToTail(trans);
+			}
+		});
+		double editMs = timeMs([&] {
+			for (size_t i = 0; i < data.size(); i++) {
+				list.removeHead();
+				list.addToTail(data[i]);
+			}
+		});
+		double clearMs = timeMs([&] {
+			list.clear();
+		});
+		cout << name << " nodes: fill " << fillMs << " ms, edit " << editMs
+				<< " ms, clear " << clearMs << " ms" << endl;
+	};
+	{
+		LinkedList<Transaction, HeapPolicy> heapList;
+		allocationRun(heapList, "heap");
+		LinkedList<Transaction, ArenaPolicy> arenaList;
+		allocationRun(arenaList, "arena");
+		//pools keep their slabs, so this goes last
+		RowList poolList;
+		allocationRun(poolList, "pool");
+	}
+	HeapPolicy::counters().print("heap");
+	PoolPolicy::counters().print("pool");
+	ArenaPolicy::counters().print("arena");
+
+	//integrity checking against parsing the same file contents
+	string text;
+	for (const Transaction &trans : data) {
+		text += formatTransaction(trans);
+		text += '\n';
+	}
+	size_t parsed = 0;
+	double parseMs = timeMs([&] {
+		Transaction trans;
+		string line;
+		size_t pos = 0;
+		while (pos < text.size()) {
+			size_t nl = text.find('\n', pos);
+			line.assign(text, pos, nl - pos);
+			parsed += trans.readLine(line);
+			pos = nl + 1;
+		}
+	});
+	string checksum;
+	double crcMs = timeMs([&] {
+		checksum = checksumLine(text);
+	});
+	cout << "parse " << parsed << " rows " << parseMs << " ms, CRC32C of "
+			<< text.size() / 1024 << " KiB " << crcMs << " ms" << endl;
+
+	//encryption against the cost of getting the same bytes to disk
+	string sealed;
+	double sealMs = timeMs([&] {
+		sealed = sealText(text);
+	});
+	string opened;
+	double openMs = timeMs([&] {
+		bool isSealed;
+		opened = openSealed(string(sealed), "benchmark", isSealed);
+	});
+	const string benchFile = "benchmark.tmp";
+	double diskMs = timeMs([&] {
+		replaceFile(benchFile, sealed);
+	});
+	unlink(benchFile.c_str());
+	double mb = text.size() / 1048576.0;
+	cout << "AES-GCM seal " << mb / sealMs * 1000 << " MB/s, open "
+			<< mb / openMs * 1000 << " MB/s" << (opened == text ? "" : " (MISMATCH)")
+			<< ", write+fsync " << mb / diskMs * 1000 << " MB/s" << endl;
+
+	//the same file through each I/O backend
+	vector<std::unique_ptr<IoBackend>> backends;
+	try {
+		backends.emplace_back(new UringBackend());
+	} catch (const FileException &e) {
+		cout << "io_uring is not available here" << endl;
+	}
+	backends.emplace_back(new PreadBackend());
+	for (const std::unique_ptr<IoBackend> &io : backends) {
+		double writeMs = timeMs([&] {
+			FileReplace(benchFile, sealed, *io).commit();
+		});
+		string image;
+		double readMs = timeMs([&] {
+			image = FileRead(benchFile, *io).finish();
+		});
+		unlink(benchFile.c_str());
+		cout << io->name() << ": write+fsync " << mb / writeMs * 1000
+				<< " MB/s, read " << mb / readMs * 1000 << " MB/s"
+				<< (image == sealed ? "" : " (MISMATCH)") << endl;
 	}
 
-	int index = transList.selectTransaction();
-	transList.deleteTransaction(index);
+	//segmented save and load, with reads and writes overlapping the
+	//sealing and opening of neighbouring segments
+	const string benchLedger = "benchmark.csv";
+	double saveMs = timeMs([&] {
+		writeTransactionFile(benchLedger, text);
+	});
+	string loaded;
+	double loadMs = timeMs([&] {
+		loaded = readTransactionFile(benchLedger);
+	});
+
+	//cold start from a snapshot: decrypt and copy in, then build the nodes
+	double snapshotMs = timeMs([&] {
+		writeSnapshot(benchLedger, loaded);
+	});
+	TransactionColumns snapshot;
+	bool mapped = false;
+	double mapMs = timeMs([&] {
+		mapped = readSnapshot(benchLedger, snapshot);
+	});
+	RowList snapshotRows;
+	double nodesMs = timeMs([&] {
+		for (size_t i = 0; i < snapshot.size(); i++) {
+			snapshotRows.addToTail(snapshot.row(i));
+		}
+	});
+
+	vector<SegmentInfo> segments = readManifest(benchLedger);
+	cout << "segmented save " << saveMs << " ms, load " << loadMs << " ms ("
+			<< segments.size() << " segments, "
+			<< IoBackend::forThread().name() << ", "
+			<< (loaded.size() == text.size() ? "" : "size differs, ")
+			<< loaded.size() / 1024 << " KiB)" << endl;
+	cout << "snapshot build " << snapshotMs << " ms, load " << mapMs << " ms + "
+			<< nodesMs << " ms for " << snapshotRows.size() << " nodes"
+			<< (mapped ? "" : " (snapshot rejected)") << ", text load "
+			<< loadMs + parseMs << " ms" << endl;
 }
 
-void App::searchTransaction() {
-	string keyword;
-
-	cout << "Enter keyword: ";
-	getline(cin, keyword);
-
-	printTableHeader();
-	Queue queue;
-	transList.searchTransaction(keyword, queue);
-	queue.print();
+ExportFilter::ExportFilter() :
+		fromDate(0), toDate(0), type(-1), category(-1) {
 }
 
-void App::displayTransactions() const {
-	printTableHeader();
-	transList.displayTransactions();
+bool ExportFilter::matches(const Transaction &trans) const {
+	if (!username.empty() && trans.getUsername() != username) {
+		return false;
+	}
+	if (type >= 0 && trans.getTypeInt() != type) {
+		return false;
+	}
+	if (category >= 0 && trans.getCategoryInt() != category) {
+		return false;
+	}
+	if (fromDate || toDate) {
+		uint32_t date = trans.getDateKey();
+		if ((fromDate && date < fromDate) || (toDate && date > toDate)) {
+			return false;
+		}
+	}
+	return true;
 }
 
-void App::sortTransactions() {
-	transList.sortTransactions();
-	displayTransactions();
+BufferedWriter::BufferedWriter(int fd) :
+		fd(fd), used(0) {
 }
 
-void App::printTableHeader() const {
-	cout.setf(ios::left);
-	cout.setf(ios::fixed);
-	cout << "    ";
-	cout << setw(10) << "Type";
-	cout << setw(15) << "Date";
-	cout << setw(20) << "Category";
-	cout << setw(15) << "Amount";
-	cout << "Description";
-	cout << endl;
-
-	cout.unsetf(ios::left);
+BufferedWriter::~BufferedWriter() {
+	try {
+		flush();
+	} catch (const FileException &e) {
+		//destructors must not throw; callers flush() to see errors
+	}
 }
 
-//validate date (DD/MM/YYYY)
-bool App::validateDate(const string &input) const {
-	if (input.size() != 10) {
-		return false;
+void BufferedWriter::flush() {
+	size_t written = 0;
+	while (written < used) {
+		ssize_t n = ::write(fd, buf + written, used - written);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			used = 0;
+			throw FileException("Failed to write export output.");
+		}
+		written += n;
 	}
+	used = 0;
+}
 
-	if (input[2] != '/' || input[5] != '/') {
-		return false;
+void BufferedWriter::write(std::string_view text) {
+	if (used + text.size() > sizeof(buf)) {
+		flush();
 	}
-
-	string dd = input.substr(0, 2);
-	string mm = input.substr(3, 2);
-	string yyyy = input.substr(6, 4);
-
-	int d = atoi(dd.c_str());
-	int m = atoi(mm.c_str());
-	int y = atoi(yyyy.c_str());
-
-	return d >= 1 && d <= 31 && m >= 1 && m <= 12 && y >= 2000;
+	if (text.size() > sizeof(buf)) {
+		//too big to buffer
+		size_t written = 0;
+		while (written < text.size()) {
+			ssize_t n = ::write(fd, text.data() + written,
+					text.size() - written);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw FileException("Failed to write export output.");
+			}
+			written += n;
+		}
+		return;
+	}
+	memcpy(buf + used, text.data(), text.size());
+	used += text.size();
 }
 
-//validate amount (a number)
-bool App::validateAmount(const string &input) const {
-	try {
-		size_t pos;
-		std::stod(input, &pos); // Try to convert to double
-		return pos == input.length(); // Ensure whole string was used
-	} catch (const std::invalid_argument &e) {
-		return false; // Not a number
-	} catch (const std::out_of_range &e) {
-		return false; // Out of range for double
+void BufferedWriter::write(char c) {
+	if (used == sizeof(buf)) {
+		flush();
 	}
+	buf[used++] = c;
 }
 
-User::User() :
-		admin(false) {
-
+void BufferedWriter::writeNumber(double value) {
+	char digits[32];
+	std::to_chars_result result = std::to_chars(digits,
+			digits + sizeof(digits), value);
+	write(std::string_view(digits, result.ptr - digits));
 }
 
-void User::writeToFile(ofstream &ofs) const {
-	size_t ulen = username.size();
-	size_t plen = passwordEncrypted.size();
-	size_t alen = 1;
-	ofs.write(reinterpret_cast<const char*>(&ulen), sizeof(ulen));
-	ofs.write(username.c_str(), ulen);
-	ofs.write(reinterpret_cast<const char*>(&plen), sizeof(plen));
-	ofs.write(passwordEncrypted.c_str(), plen);
-	ofs.write(reinterpret_cast<const char*>(&alen), sizeof(alen));
-	ofs.write(reinterpret_cast<const char*>(&admin), alen);
+void BufferedWriter::writeNumber(long value) {
+	char digits[24];
+	std::to_chars_result result = std::to_chars(digits,
+			digits + sizeof(digits), value);
+	write(std::string_view(digits, result.ptr - digits));
 }
 
-void User::readFromFile(ifstream &ifs) {
-	size_t ulen, plen, alen;
-	ifs.read(reinterpret_cast<char*>(&ulen), sizeof(ulen));
-	username.resize(ulen);
-	ifs.read(&username[0], ulen);
-	ifs.read(reinterpret_cast<char*>(&plen), sizeof(plen));
-	passwordEncrypted.resize(plen);
-	ifs.read(&passwordEncrypted[0], plen);
-	ifs.read(reinterpret_cast<char*>(&alen), sizeof(alen));
-	ifs.read(reinterpret_cast<char*>(&admin), alen);
+void BufferedWriter::writeCsvField(std::string_view text) {
+	if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+		write(text);
+		return;
+	}
+	write('"');
+	for (char c : text) {
+		if (c == '"') {
+			write('"');
+		}
+		write(c);
+	}
+	write('"');
 }
 
-string User::hash(const string &password) {
-	unsigned char hash[SHA256_DIGEST_LENGTH];
-	SHA256((unsigned char*) password.c_str(), password.size(), hash);
-	std::stringstream ss;
-	for (unsigned char i : hash) {
-		ss << std::hex << std::setw(2) << std::setfill('0') << (int) i;
+void BufferedWriter::writeJsonString(std::string_view text) {
+	static const char hex[] = "0123456789abcdef";
+	write('"');
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			write('\\');
+			write(c);
+		} else if ((unsigned char) c < 0x20) {
+			write("\\u00");
+			write(hex[(c >> 4) & 0xf]);
+			write(hex[c & 0xf]);
+		} else {
+			write(c);
+		}
 	}
-	return ss.str();
+	write('"');
 }
 
-User::User(const string &username, const string &password, bool admin) :
-		username(username), passwordEncrypted(hash(password)), admin(admin) {
+void scanTransactions(const string &source, const ExportFilter &filter,
+		const std::function<void(const Transaction&)> &visit) {
+	FileLock lock(source, false);
+
+	//only the segments the filter can match, then the rows appended since
+	vector<string> files;
+	for (const SegmentInfo &segment : readManifest(source)) {
+		if (segment.mayContain(filter.fromDate, filter.toDate,
+				filter.username)) {
+			files.push_back(segment.file);
+		}
+	}
+	files.push_back(source);
+
+	Transaction trans;
+	string line;
+	auto scanLine = [&]() {
+		//the user filter only needs the username prefix compared
+		if (!filter.username.empty() && !isOwnedBy(line, filter.username)) {
+			return;
+		}
+		if (trans.readLine(line) && filter.matches(trans)) {
+			visit(trans);
+		}
+	};
+
+	//split decrypted chunks into lines; only a partial line is carried over
+	for (const string &file : files) {
+		streamTransactionFile(file, [&](const char *p, size_t n) {
+			const char *end = p + n;
+			while (p < end) {
+				const char *nl = (const char*) memchr(p, '\n', end - p);
+				if (!nl) {
+					line.append(p, end);
+					break;
+				}
+				line.append(p, nl);
+				scanLine();
+				line.clear();
+				p = nl + 1;
+			}
+		});
+		if (!line.empty()) {
+			scanLine();
+			line.clear();
+		}
+	}
 }
 
-bool User::isAdmin() const {
-	return admin;
+void searchTransactionFile(const string &source, const ExportFilter &filter,
+		const string &keyword, Queue &queue) {
+	KeywordMatcher matcher(keyword);
+	scanTransactions(source, filter, [&](const Transaction &trans) {
+		if (matcher.matches(trans.getCategoryInt(), trans.getDescription(),
+				trans.getDate())) {
+			queue.push(trans);
+		}
+	});
 }
 
-const string& User::getPassword() const {
-	return passwordEncrypted;
+void groupTransactionFile(const string &source, const ExportFilter &filter,
+		int fields, vector<GroupTotal> &out) {
+	//rows stay where they are put, so the pointers to them hold
+	std::deque<Transaction> kept;
+	map<string, uint32_t> userIds;
+	vector<const string*> users;
+	vector<std::pair<const Transaction*, uint32_t>> rows;
+	scanTransactions(source, filter, [&](const Transaction &trans) {
+		auto user = userIds.emplace(trans.getUsername(), users.size());
+		if (user.second) {
+			users.push_back(&user.first->first);
+		}
+		kept.push_back(trans);
+		rows.emplace_back(&kept.back(), user.first->second);
+	});
+	groupRows(fields, users, rows, out);
 }
 
-const string& User::getUsername() const {
-	return username;
+size_t exportTransactions(const string &source, const ExportFilter &filter,
+		ExportFormat format, int outFd) {
+	BufferedWriter out(outFd);
+	if (format == ExportCsv) {
+		out.write("username,type,date,category,description,amount\n");
+	}
+
+	size_t rows = 0;
+	scanTransactions(source, filter, [&](const Transaction &trans) {
+		if (format == ExportCsv) {
+			out.writeCsvField(trans.getUsername());
+			out.write(',');
+			out.write(trans.getType());
+			out.write(',');
+			out.write(trans.getDate());
+			out.write(',');
+			out.write(trans.getCategory());
+			out.write(',');
+			out.writeCsvField(trans.getDescription());
+			out.write(',');
+			out.writeNumber(trans.getAmount());
+			out.write('\n');
+		} else {
+			out.write("{\"username\":");
+			out.writeJsonString(trans.getUsername());
+			out.write(",\"type\":\"");
+			out.write(trans.getType());
+			out.write("\",\"date\":\"");
+			out.write(trans.getDate());
+			out.write("\",\"category\":\"");
+			out.write(trans.getCategory());
+			out.write("\",\"description\":");
+			out.writeJsonString(trans.getDescription());
+			out.write(",\"amount\":");
+			out.writeNumber(trans.getAmount());
+			out.write("}\n");
+		}
+		rows++;
+	});
+
+	out.flush();
+	return rows;
 }